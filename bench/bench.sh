@@ -0,0 +1,134 @@
+#!/bin/sh
+#
+# bench.sh still-sim [options...]
+#
+# Run still-sim --stats across accelerometer ODRs and buffer sizes, moving the
+# simulated accelerometer once per run after calibration, and print one record
+# per ODR and buffer size.  Extra options are passed to every run.
+#
+# Records:
+# odr, buffer: the configuration
+# runs: runs made
+# false_triggers: runs that triggered before the movement, or on an overflow
+# misses: runs that never triggered
+# samples_per_s: samples read per simulated second
+# lost_per_s: samples overwritten or dropped by the accelerometer per second
+# transactions_per_sample: I2C transactions per sample read
+# detector_ns_per_sample: time per detector update, in ns
+# wakeups_per_s: sleeps and interrupt waits per simulated second
+# latency_p50_ms, latency_p90_ms, latency_p99_ms, latency_max_ms:
+# 		movement to trigger, over the runs that detected it
+#
+# Environment:
+# FORMAT: json (default) or csv
+# ODRS: ODRs to run, in Hz (all of them)
+# BUFFERS: --buffer sizes to run (8 32 128 512)
+# RUNS: runs per configuration, each with its own seed and movement (10)
+# AMPLITUDE: movement step, in g (0.05)
+
+still=${1:?usage: bench.sh still-sim [options...]}
+shift
+
+FORMAT=${FORMAT:-json}
+ODRS=${ODRS:-"3.125 6.25 12.5 25 50 100 200 400 800 1600"}
+BUFFERS=${BUFFERS:-"8 32 128 512"}
+RUNS=${RUNS:-10}
+AMPLITUDE=${AMPLITUDE:-0.05}
+
+discard=1000
+
+case $FORMAT in
+json)
+	echo "[" ;;
+csv)
+	echo "odr,buffer,runs,false_triggers,misses,samples_per_s,lost_per_s,transactions_per_sample,detector_ns_per_sample,wakeups_per_s,latency_p50_ms,latency_p90_ms,latency_p99_ms,latency_max_ms" ;;
+*)
+	echo "FORMAT must be json or csv" >&2
+	exit 1 ;;
+esac
+
+first=1
+for odr in $ODRS; do
+	for buffer in $BUFFERS; do
+		# move once calibration is done, at a different phase every run
+		calibration=$(awk -v b=$buffer -v o=$odr 'BEGIN { printf "%d", b * 1000 / o + 1 }')
+		run=1
+		while [ $run -le $RUNS ]; do
+			start=$((discard + calibration + 500 + run * 137 % 1000))
+			"$still" --simulate --stats --odr $odr --buffer $buffer --discard $discard \
+					--sim-seed $run --sim-motion $start:600000:$AMPLITUDE \
+					--sim-duration $((start + 120000)) "$@" 2>&1 >/dev/null | grep '^{'
+			run=$((run + 1))
+		done | awk -v odr=$odr -v buffer=$buffer -v format=$FORMAT -v first=$first '
+			function field(key,   s) {
+				if(!match($0, "\"" key "\": [-0-9.]+"))
+					return 0
+				s = substr($0, RSTART, RLENGTH)
+				sub(/.*: /, "", s)
+				return s + 0
+			}
+			function percentile(p,   i) {
+				if(n == 0)
+					return format == "json" ? "null" : ""
+				i = int(p * n + 0.999999)
+				return sprintf("%.3f", latency[i < 1 ? 1 : i])
+			}
+			{
+				runs++
+				sim_s += field("sim_ms") / 1000
+				samples += field("samples")
+				lost += field("lost")
+				transactions += field("transactions")
+				wakeups += field("wakeups")
+				updates += field("updates")
+				detector_ns += field("detector_ns")
+				if($0 ~ /"result": "timeout"/)
+					misses++
+				else if($0 ~ /"result": "overflow"/ || field("sim_ms") < field("motion_ms"))
+					false_triggers++
+				else {
+					# insert the latency in order
+					l = field("sim_ms") - field("motion_ms")
+					for(i = ++n; i > 1 && latency[i - 1] > l; i--)
+						latency[i] = latency[i - 1]
+					latency[i] = l
+				}
+			}
+			END {
+				split("odr buffer runs false_triggers misses samples_per_s lost_per_s " \
+						"transactions_per_sample detector_ns_per_sample wakeups_per_s " \
+						"latency_p50_ms latency_p90_ms latency_p99_ms latency_max_ms", names)
+				v[1] = odr
+				v[2] = buffer
+				v[3] = runs + 0
+				v[4] = false_triggers + 0
+				v[5] = misses + 0
+				v[6] = sprintf("%.1f", sim_s ? samples / sim_s : 0)
+				v[7] = sprintf("%.1f", sim_s ? lost / sim_s : 0)
+				v[8] = sprintf("%.3f", samples ? transactions / samples : 0)
+				v[9] = sprintf("%.1f", updates ? detector_ns / updates : 0)
+				v[10] = sprintf("%.1f", sim_s ? wakeups / sim_s : 0)
+				v[11] = percentile(0.5)
+				v[12] = percentile(0.9)
+				v[13] = percentile(0.99)
+				v[14] = percentile(1)
+				if(format == "json") {
+					line = (first ? "" : ",\n") "  {"
+					for(i = 1; i <= 14; i++)
+						line = line (i > 1 ? ", " : "") "\"" names[i] "\": " v[i]
+					printf "%s}", line
+				} else {
+					line = v[1]
+					for(i = 2; i <= 14; i++)
+						line = line "," v[i]
+					print line
+				}
+			}'
+		first=0
+	done
+done
+
+if [ $FORMAT = json ]; then
+	echo
+	echo "]"
+fi
@@ -14,8 +14,10 @@ Magnetometer registers).
 
 Development environment specifics:
   Code developed in Intel's Eclipse IOT-DK
-  This code requires the Intel mraa library to function; for more
+  This code requires the Intel mraa library to talk to real hardware; for more
   information see https://github.com/intel-iot-devkit/mraa
+  Without it (build with NO_MRAA defined), the driver can still talk to any
+  other I2cBus, such as a SimLSM9DS0.
 
 This code is beerware; if you see me (or any other SparkFun employee) at the
 local, and you've found our code helpful, please buy us a round!
@@ -26,7 +28,7 @@ Distributed as-is; no warranty is given.
 #define __SFE_LSM9DS0_H__
 
 #include <stdint.h>
-#include "mraa.hpp"
+#include "i2c_bus.h"
 
 ////////////////////////////
 // LSM9DS0 Gyro Registers //
@@ -200,6 +202,71 @@ public:
 		M_ODR_100,	// 100 Hz (0x05)
 	};
 
+	// fifo_mode defines the FIFO modes of the accelerometer (FIFO_CTRL_REG FM[2:0]):
+	enum fifo_mode
+	{
+		FIFO_BYPASS,			// 000: Bypass mode, FIFO not used
+		FIFO_FIFO,				// 001: FIFO mode, stops collecting when full
+		FIFO_STREAM,			// 010: Stream mode, oldest sample discarded when full
+		FIFO_STREAM_TO_FIFO,	// 011: Stream mode until interrupt, then FIFO mode
+		FIFO_BYPASS_TO_STREAM	// 100: Bypass mode until interrupt, then stream mode
+	};
+
+	// init_sensors defines the sensors begin() can initialize. OR them
+	// together to initialize more than one:
+	enum init_sensors
+	{
+		INIT_GYRO	= 0x1,	// Gyroscope
+		INIT_ACCEL	= 0x2,	// Accelerometer
+		INIT_MAG	= 0x4,	// Magnetometer (and temperature sensor)
+		INIT_ALL	= 0x7,
+	};
+
+	// int1_xm_src defines the signals that can be routed to the INT1_XM pin
+	// (CTRL_REG3_XM). OR them together to route more than one:
+	enum int1_xm_src
+	{
+		INT1_XM_BOOT	= 0x80,	// Boot
+		INT1_XM_TAP		= 0x40,	// Click generator
+		INT1_XM_INTGEN1	= 0x20,	// Inertial interrupt generator 1
+		INT1_XM_INTGEN2	= 0x10,	// Inertial interrupt generator 2
+		INT1_XM_INTM	= 0x08,	// Magnetic interrupt
+		INT1_XM_DRDYA	= 0x04,	// Accelerometer data ready
+		INT1_XM_DRDYM	= 0x02,	// Magnetometer data ready
+		INT1_XM_EMPTY	= 0x01,	// FIFO empty
+	};
+
+	// int2_xm_src defines the signals that can be routed to the INT2_XM pin
+	// (CTRL_REG4_XM). OR them together to route more than one:
+	enum int2_xm_src
+	{
+		INT2_XM_TAP		= 0x80,	// Click generator
+		INT2_XM_INTGEN1	= 0x40,	// Inertial interrupt generator 1
+		INT2_XM_INTGEN2	= 0x20,	// Inertial interrupt generator 2
+		INT2_XM_INTM	= 0x10,	// Magnetic interrupt
+		INT2_XM_DRDYA	= 0x08,	// Accelerometer data ready
+		INT2_XM_DRDYM	= 0x04,	// Magnetometer data ready
+		INT2_XM_OVERRUN	= 0x02,	// FIFO overrun
+		INT2_XM_WTM		= 0x01,	// FIFO watermark
+	};
+
+	// int_gen_cfg defines the events the inertial interrupt generators can
+	// watch for (INT_GEN_1_REG, INT_GEN_2_REG). OR them together:
+	enum int_gen_cfg
+	{
+		INT_GEN_AOI		= 0x80,	// AND (1) or OR (0) the enabled events
+		INT_GEN_6D		= 0x40,	// 6-direction detection
+		INT_GEN_ZHIE	= 0x20,	// Z high event
+		INT_GEN_ZLIE	= 0x10,	// Z low event
+		INT_GEN_YHIE	= 0x08,	// Y high event
+		INT_GEN_YLIE	= 0x04,	// Y low event
+		INT_GEN_XHIE	= 0x02,	// X high event
+		INT_GEN_XLIE	= 0x01,	// X low event
+	};
+
+	// Number of samples the accelerometer FIFO can hold
+	static const uint8_t ACCEL_FIFO_DEPTH = 32;
+
 	// We'll store the gyro, accel, and magnetometer readings in a series of
 	// public class variables. Each sensor gets three variables -- one for each
 	// axis. Call readGyro(), readAccel(), and readMag() first, before using
@@ -210,17 +277,39 @@ public:
 	int16_t mx, my, mz; // x, y, and z axis readings of the magnetometer
   int16_t temperature;
 
+#ifndef NO_MRAA
 	// LSM9DS0 -- LSM9DS0 class constructor
 	// The constructor will set up a handful of private variables, and set the
 	// communication mode as well.
 	// Input:
 	//	- gAddr = I2C address of the gyroscope.
 	//	- xmAddr = I2C address of the accel/mag.
-	LSM9DS0(uint8_t gAddr, uint8_t xmAddr);
+	//	- bus = mraa I2C bus number, 1 by default.
+	LSM9DS0(uint8_t gAddr, uint8_t xmAddr, int bus = 1);
+#endif
+
+	// LSM9DS0 -- LSM9DS0 class constructor for any bus
+	// Input:
+	//	- gyroBus = The gyroscope's bus.
+	//	- xmBus = The accel/mag's bus.
+	LSM9DS0(I2cBus* gyroBus, I2cBus* xmBus);
+
+	// setBusSpeed() -- Clock the I2C bus the gyro and accel/mag are on.
+	// The LSM9DS0 supports standard (100 kHz) and fast (400 kHz) mode; at
+	// the higher accelerometer ODRs, fast mode leaves room to drain the FIFO.
+	// Call it before begin() so the setup writes go out at the new speed.
+	// Input:
+	//	- hz = The bus clock in Hz, e.g. 100000 or 400000.
+	// Output: true if both buses accepted the speed.
+	bool setBusSpeed(int hz);
 	
 	// begin() -- Initialize the gyro, accelerometer, and magnetometer.
 	// This will set up the scale and output rate of each sensor. It'll also
 	// "turn on" every sensor and every axis of every sensor.
+	// Each sensor's control registers are written in one burst, and a copy
+	// is kept so that the setters below never have to read them back.
+	// Sensors left out of the sensors mask stay untouched until one of their
+	// read or set functions is first called, which initializes them then.
 	// Input:
 	//	- gScl = The scale of the gyroscope. This should be a gyro_scale value.
 	//	- aScl = The scale of the accelerometer. Should be a accel_scale value.
@@ -228,29 +317,57 @@ public:
 	//	- gODR = Output data rate of the gyroscope. gyro_odr value.
 	//	- aODR = Output data rate of the accelerometer. accel_odr value.
 	//	- mODR = Output data rate of the magnetometer. mag_odr value.
+	//	- aABW = Anti-aliasing filter of the accelerometer. accel_abw value.
+	//	- sensors = The sensors to initialize. init_sensors values OR'ed
+	//		together.
 	// Output: The function will return an unsigned 16-bit value. The most-sig
 	//		bytes of the output are the WHO_AM_I reading of the accel. The
 	//		least significant two bytes are the WHO_AM_I reading of the gyro.
+	//		The WHO_AM_I of a device that wasn't initialized reads as 0.
 	// All parameters have a defaulted value, so you can call just "begin()".
 	// Default values are FSR's of:  245DPS, 2g, 2Gs; ODRs of 95 Hz for 
-	// gyro, 100 Hz for accelerometer, 100 Hz for magnetometer.
+	// gyro, 100 Hz for accelerometer, 100 Hz for magnetometer; 773 Hz
+	// accelerometer anti-aliasing; all sensors initialized.
 	// Use the return value of this function to verify communication.
 	uint16_t begin(gyro_scale gScl = G_SCALE_245DPS, 
 				accel_scale aScl = A_SCALE_2G, mag_scale mScl = M_SCALE_2GS,
 				gyro_odr gODR = G_ODR_95_BW_125, accel_odr aODR = A_ODR_50, 
-				mag_odr mODR = M_ODR_50);
+				mag_odr mODR = M_ODR_50, accel_abw aABW = A_ABW_773,
+				uint8_t sensors = INIT_ALL);
 	
 	// readGyro() -- Read the gyroscope output registers.
 	// This function will read all six gyroscope output registers.
 	// The readings are stored in the class' gx, gy, and gz variables. Read
 	// those _after_ calling readGyro().
 	void readGyro();
+
+	// readGyroWithStatus() -- Read STATUS_REG_G and the gyroscope output
+	// registers in one seven byte burst, like readAccelWithStatus().
+	// STATUS_REG_G has the same layout as STATUS_REG_A, so decode it with
+	// accelStatusNewData() and accelStatusOverflow().
+	// Output: The STATUS_REG_G value read with the readings.
+	uint8_t readGyroWithStatus();
 	
 	// readAccel() -- Read the accelerometer output registers.
 	// This function will read all six accelerometer output registers.
 	// The readings are stored in the class' ax, ay, and az variables. Read
 	// those _after_ calling readAccel().
 	void readAccel();
+
+	// readAccelWithStatus() -- Read STATUS_REG_A and the accelerometer output
+	// registers together.
+	// STATUS_REG_A sits just before OUT_X_L_A, so this is one seven byte
+	// auto-increment burst instead of the separate reads newXData(),
+	// readAccel() and xDataOverflow() would take. The readings are stored
+	// in ax, ay, and az, but are only new if accelStatusNewData() says so.
+	// Output: The STATUS_REG_A value read with the readings.
+	uint8_t readAccelWithStatus();
+
+	// These functions decode a STATUS_REG_A value as returned by
+	// readAccelWithStatus(): new data on all axes (ZYXDA) and data
+	// overwritten before it was read (ZYXOR).
+	static bool accelStatusNewData(uint8_t status);
+	static bool accelStatusOverflow(uint8_t status);
 	
 	// readMag() -- Read the magnetometer output registers.
 	// This function will read all six magnetometer output registers.
@@ -258,6 +375,13 @@ public:
 	// those _after_ calling readMag().
 	void readMag();
 
+	// readMagWithStatus() -- Read STATUS_REG_M and the magnetometer output
+	// registers in one seven byte burst, like readAccelWithStatus().
+	// STATUS_REG_M has the same layout as STATUS_REG_A, so decode it with
+	// accelStatusNewData() and accelStatusOverflow().
+	// Output: The STATUS_REG_M value read with the readings.
+	uint8_t readMagWithStatus();
+
 	// readTemp() -- Read the temperature output register.
 	// This function will read two temperature output registers.
 	// The combined readings are stored in the class' temperature variables. 
@@ -348,10 +472,96 @@ public:
   bool gDataOverflow();
   bool mDataOverflow();
 
+	// setInt1XMSources() -- Choose which signals drive the INT1_XM pin.
+	// initAccel() routes accelerometer data ready (INT1_XM_DRDYA) here.
+	// Input:
+	//	- sources = int1_xm_src values OR'ed together, 0 for none.
+	void setInt1XMSources(uint8_t sources);
+
+	// setInt2XMSources() -- Choose which signals drive the INT2_XM pin.
+	// initMag() routes magnetometer data ready (INT2_XM_DRDYM) here.
+	// Input:
+	//	- sources = int2_xm_src values OR'ed together, 0 for none.
+	void setInt2XMSources(uint8_t sources);
+
+	// configAccelIntGen1() and configAccelIntGen2() -- Set up an inertial
+	// interrupt generator. The generator compares the absolute acceleration
+	// on each axis against the threshold.
+	// Input:
+	//	- config = int_gen_cfg values OR'ed together, 0 to disable.
+	//	- threshold = 7-bit threshold, see calcAccelIntGenThreshold().
+	//	- duration = 7-bit number of samples (1/ODR) the event must last.
+	void configAccelIntGen1(uint8_t config, uint8_t threshold, uint8_t duration);
+	void configAccelIntGen2(uint8_t config, uint8_t threshold, uint8_t duration);
+
+	// accelIntGen1Source() and accelIntGen2Source() -- Read INT_GEN_x_SRC.
+	// Reading clears a latched interrupt.
+	// Output: Bits[7:0]: 0 IA ZH ZL YH YL XH XL
+	uint8_t accelIntGen1Source();
+	uint8_t accelIntGen2Source();
+
+	// accelIntGenActive() -- Decode the IA bit of an INT_GEN_x_SRC value.
+	static bool accelIntGenActive(uint8_t intGenSource);
+
+	// setAccelIntGenHPF() -- Filter the data seen by the interrupt generators
+	// through the internal high-pass filter (HPIS1/HPIS2 in CTRL_REG0_XM),
+	// so they respond to changes rather than to gravity.
+	void setAccelIntGenHPF(bool intGen1, bool intGen2);
+
+	// latchAccelIntGen() -- Latch interrupt generator requests until their
+	// INT_GEN_x_SRC register is read (LIR1/LIR2 in CTRL_REG5_XM).
+	void latchAccelIntGen(bool intGen1, bool intGen2);
+
+	// calcAccelIntGenThreshold() -- Convert g's to an interrupt generator
+	// threshold. One LSB is 1/128th of the full scale, so this relies
+	// on aScale being correct. Rounds to nearest, clamped to 1-127.
+	// Input:
+	//	- g = Threshold in g's.
+	uint8_t calcAccelIntGenThreshold(float g);
+
+	// enableAccelFIFO() -- Turn on the accelerometer FIFO.
+	// Sets FIFO_EN (and optionally WTM_EN) in CTRL_REG0_XM and writes the
+	// mode and watermark level to FIFO_CTRL_REG.
+	// Input:
+	//	- mode = The FIFO mode. Must be a value from the fifo_mode enum.
+	//	- watermark = FIFO level (0-31) at which the WTM flag in FIFO_SRC_REG
+	//		is raised.
+	//	- limitDepth = Set WTM_EN, which limits the FIFO depth to the
+	//		watermark level instead of the full ACCEL_FIFO_DEPTH.
+	void enableAccelFIFO(fifo_mode mode, uint8_t watermark = 0,
+				bool limitDepth = false);
+
+	// disableAccelFIFO() -- Put the FIFO back in bypass mode and turn it off.
+	void disableAccelFIFO();
+
+	// accelFIFOStatus() -- Read FIFO_SRC_REG.
+	// Output: Bits[7:0]: WTM OVRN EMPTY FSS4 FSS3 FSS2 FSS1 FSS0
+	uint8_t accelFIFOStatus();
+
+	// These functions decode a FIFO_SRC_REG value as read by
+	// accelFIFOStatus(), so that one register read can answer all of them.
+	// accelFIFOSamples() counts an overrun FIFO as ACCEL_FIFO_DEPTH samples,
+	// since FSS only goes up to 31; that assumes limitDepth wasn't set.
+	static uint8_t accelFIFOSamples(uint8_t fifoStatus);
+	static bool accelFIFOWatermark(uint8_t fifoStatus);
+	static bool accelFIFOOverrun(uint8_t fifoStatus);
+
+	// readAccelFIFO() -- Drain samples from the accelerometer FIFO.
+	// All samples are read in a single auto-increment burst; the output
+	// register address rolls over from OUT_Z_H_A to OUT_X_L_A while the FIFO
+	// is enabled, so every 6 bytes is the next stored sample.
+	// The last sample drained is also stored in ax, ay, and az.
+	// Input:
+	//	- dest = An array of at least 3 * count int16_t's. Samples are stored
+	//		as interleaved x, y, z raw readings, oldest first.
+	//	- count = The number of samples to read, at most ACCEL_FIFO_DEPTH.
+	//		Use accelFIFOSamples() to find out how many are stored.
+	void readAccelFIFO(int16_t * dest, uint8_t count);
+
 private:	
 
-  mraa::I2c* gyro;
-  mraa::I2c* xm;
+  I2cBus* gyro;
+  I2cBus* xm;
 	// gScale, aScale, and mScale store the current scale range for each 
 	// sensor. Should be updated whenever that value changes.
 	gyro_scale gScale;
@@ -362,6 +572,32 @@ private:
 	// Units of these values would be DPS (or g's or Gs's) per ADC tick.
 	// This value is calculated as (sensor scale) / (2^15).
 	float gRes, aRes, mRes;
+
+	// initialized stores the init_sensors that have been turned on, by
+	// begin() or lazily.
+	uint8_t initialized;
+
+	// While holdCtrlWrites is set, gWriteCtrl() and xmWriteCtrl() only
+	// update the shadow copies, to be written later in a burst.
+	bool holdCtrlWrites;
+
+	// Shadow copies of the gyro (CTRL_REG1_G-CTRL_REG5_G) and accel/mag
+	// (CTRL_REG0_XM-CTRL_REG7_XM) control registers, so that changing a
+	// few bits is a write instead of a read-modify-write. The valid flags
+	// are cleared until the copies have been read back or fully written.
+	uint8_t gCtrl[5];
+	uint8_t xmCtrl[8];
+	bool gCtrlValid, xmCtrlValid;
+
+	// initSensors() -- Turn on any of the given sensors that aren't already.
+	// Each sensor is set up by its init function, then given its rate and
+	// the current scale, then its control registers are written in a burst.
+	// Input:
+	//	- sensors = init_sensors values OR'ed together.
+	//	- gODR, aODR, aABW, mODR = As for begin().
+	void initSensors(uint8_t sensors, gyro_odr gODR = G_ODR_95_BW_125,
+				accel_odr aODR = A_ODR_50, accel_abw aABW = A_ABW_773,
+				mag_odr mODR = M_ODR_50);
 	
 	// initGyro() -- Sets up the gyroscope to begin reading.
 	// This function steps through all five gyroscope control registers.
@@ -422,6 +658,34 @@ private:
 	//	- data = data to be written to the register.
 	void gWriteByte(uint8_t subAddress, uint8_t data);
 	
+	// gWriteCtrl() and xmWriteCtrl() -- Write a control register of the
+	// gyro or accel/mag, keeping its shadow copy up to date.
+	// Input:
+	//	- subAddress = Control register to be written to.
+	//	- data = data to be written to the register.
+	void gWriteCtrl(uint8_t subAddress, uint8_t data);
+	void xmWriteCtrl(uint8_t subAddress, uint8_t data);
+
+	// gReadCtrl() and xmReadCtrl() -- Read a control register of the gyro
+	// or accel/mag from its shadow copy. The first call reads back all of
+	// that device's control registers in one burst.
+	// Input:
+	//	- subAddress = Control register to be read from.
+	// Output:
+	//	- The register's 8-bit value.
+	uint8_t gReadCtrl(uint8_t subAddress);
+	uint8_t xmReadCtrl(uint8_t subAddress);
+
+	// gWriteBytes() and xmWriteBytes() -- Write a number of bytes --
+	// beginning at an address and incrementing from there -- to the gyro
+	// or accel/mag.
+	// Input:
+	//	- subAddress = Register to be written to.
+	//	- * src = An array of up to eight uint8_t's to write.
+	//	- count = The number of bytes to be written.
+	void gWriteBytes(uint8_t subAddress, uint8_t * src, uint8_t count);
+	void xmWriteBytes(uint8_t subAddress, uint8_t * src, uint8_t count);
+
 	// xmReadByte() -- Read a byte from a register in the accel/mag sensor
 	// Input:
 	//	- subAddress = Register to be read from.
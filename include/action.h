@@ -0,0 +1,60 @@
+/*
+ * action.h
+ *
+ * Actions run on movement without interrupting sampling.  Each rule maps a
+ * band of deviation from the calibrated mean to a command, with its own
+ * cooldown and debounce.  Commands are started with posix_spawn and reaped
+ * from a SIGCHLD handler, so nothing ever waits on them.
+ */
+
+#ifndef __ACTION_H__
+#define __ACTION_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * A rule and its state.  Zero the state fields before action_init().
+ */
+struct action_rule {
+	// lowest deviation in the band, as a fraction of the calibrated magnitude
+	float min;
+	// time after firing before the rule (or any milder one) fires again
+	int cooldown_ms;
+	// consecutive samples at or above min before the rule fires
+	int debounce;
+	// the executable, and its NULL-terminated arguments
+	char *path;
+	char **argv;
+
+	// consecutive samples at or above min so far
+	int matched;
+	// when the cooldown ends
+	int64_t quiet_until_ns;
+	// the running command, or 0; cleared by the SIGCHLD handler, so only
+	// ever accessed with __atomic loads and stores
+	pid_t pid;
+	// times fired, and times skipped because the last command still ran
+	uint64_t fired;
+	uint64_t busy;
+};
+
+/*
+ * Start reaping children for the n rules starting with *rules, which must be
+ * sorted by min, highest first, and outlive every command they start
+ */
+void action_init(struct action_rule *rules, int n);
+/*
+ * Account for a sample deviating by deviation at now_ns.  The most severe
+ * rule that has been matched for its debounce, isn't cooling down and isn't
+ * still running fires; firing also starts the cooldown of every milder rule,
+ * so one event runs one command.  Returns the index of the rule fired, or -1.
+ */
+int action_update(struct action_rule *rules, int n, float deviation, int64_t now_ns);
+/*
+ * Start rule *r's command, with STILL_DEVIATION set to deviation in its
+ * environment.  Returns false if it couldn't be started.
+ */
+bool action_spawn(struct action_rule *r, float deviation);
+
+#endif // __ACTION_H__
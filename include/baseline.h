@@ -0,0 +1,79 @@
+/*
+ * baseline.h
+ *
+ * Tracking of a device's calibrated mean as it drifts, e.g. as the sun warms
+ * the accelerometer over a day.  The reference follows the samples very
+ * slowly, and only once the device has been confirmed quiet: deviation well
+ * under the threshold for a while.  Movement pushes the deviation up first,
+ * which stops the tracking before the reference can follow it.
+ *
+ * The temperature, read every so often, adds a model on top: a per-axis
+ * coefficient (g per degree) fitted by least squares to quiet stretches of
+ * samples and their temperatures.  The reference is moved along it as the
+ * temperature changes, even while the tracking itself is stopped.
+ */
+
+#ifndef __BASELINE_H__
+#define __BASELINE_H__
+
+#include <stdint.h>
+
+#include "xyz.h"
+
+class Baseline {
+public:
+	/*
+	 * Track from calibrated mean *mean (g) for a device sampled at odr_hz.
+	 * The reference follows confirmed quiet samples with a time constant of
+	 * tau_s seconds.  A sample is quiet while the deviation is under quiet,
+	 * and confirmed once confirm_s seconds of samples have all been quiet.
+	 */
+	Baseline(const struct xyz *mean, float odr_hz, float tau_s, float quiet,
+			float confirm_s);
+
+	/*
+	 * Account for sample *p (g), whose deviation from the reference was
+	 * deviation
+	 */
+	void update(const struct xyz *p, float deviation);
+	/*
+	 * Account for a temperature reading, in degrees C.  Every quiet sample
+	 * since the last reading is fitted against it.
+	 */
+	void temperature(float celsius);
+	/*
+	 * Write the current reference (g) to *mean
+	 */
+	void reference(struct xyz *mean);
+	/*
+	 * Return the fitted coefficient (g per degree C), 0 until the quiet
+	 * readings' temperatures have a standard deviation of half a degree
+	 */
+	const struct xyz *coefficient();
+	/*
+	 * Return how many samples the reference has followed
+	 */
+	uint64_t tracked();
+
+private:
+	float alpha;		// per quiet sample
+	float quiet;
+	uint32_t confirm;	// quiet samples before tracking
+	uint32_t quiet_run;	// consecutive quiet samples
+
+	struct xyz base;	// the reference at the first temperature reading
+	struct xyz coeff;
+	bool have_temperature;
+	float first_celsius, celsius;
+	uint64_t tracked_samples;
+
+	// the confirmed quiet samples since the last reading
+	double interval_x, interval_y, interval_z;
+	uint32_t interval_n;
+	bool interval_quiet;
+
+	// least squares sums of temperature (from first_celsius) against mean
+	double n, st, stt, sx, sy, sz, stx, sty, stz;
+};
+
+#endif // __BASELINE_H__
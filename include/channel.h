@@ -0,0 +1,78 @@
+/*
+ * channel.h
+ *
+ * A detection channel for a sensor other than the accelerometer.  Each channel
+ * keeps its own schedule from the sensor's ODR, so it's only read when a new
+ * sample should be ready, and its own window, calibration and threshold.
+ */
+
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+#include <stdint.h>
+
+#include "xyz.h"
+#include "detector.h"
+
+class Channel {
+public:
+	/*
+	 * Watch a sensor that produces a sample every period_ns through a window
+	 * of n samples.  The sensor has moved once detector finds the window
+	 * threshold away from the calibrated mean or, with relative set,
+	 * threshold times the calibrated mean's magnitude.  The channel owns
+	 * detector.
+	 */
+	Channel(Detector *detector, int n, float threshold, bool relative, int64_t period_ns);
+	~Channel();
+
+	/*
+	 * Return when the next sample should be ready
+	 */
+	int64_t due();
+	/*
+	 * Account for a read at now_ns that found no new sample, and check again
+	 * soon
+	 */
+	void notReady(int64_t now_ns);
+	/*
+	 * Account for a read at now_ns that found no usable sample (e.g. during
+	 * the discard time), and wait for the next one
+	 */
+	void skip(int64_t now_ns);
+	/*
+	 * Account for sample *p read at now_ns.  Returns true if the sensor has
+	 * moved.
+	 */
+	bool update(const struct xyz *p, int64_t now_ns);
+	/*
+	 * Has the channel calibrated yet?
+	 */
+	bool calibrated();
+	/*
+	 * Did the last update() find movement?
+	 */
+	bool moved();
+	/*
+	 * Return the distance from the calibrated mean as a fraction of the
+	 * threshold distance, so 1 or more has moved, or 0 until calibrated
+	 */
+	float ratio();
+
+private:
+	Detector *detector;
+	int n;
+	float threshold;
+	bool relative;
+	int64_t period;
+
+	int64_t next;
+	struct xyz *window;
+	int pos;
+	int samples;
+	struct xyz mean;
+	float limit;
+	bool has_moved;
+};
+
+#endif // __CHANNEL_H__
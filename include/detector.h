@@ -0,0 +1,142 @@
+/*
+ * detector.h
+ *
+ * Movement detectors.  A detector watches a window of accelerometer samples
+ * that have been renormalized from the calibrated mean, and decides whether
+ * the accelerometer has moved.  Every detector does O(1) work per sample.
+ */
+
+#ifndef __DETECTOR_H__
+#define __DETECTOR_H__
+
+#include <string>
+
+#include "xyz.h"
+
+class Detector {
+public:
+	virtual ~Detector() {}
+
+	/*
+	 * Start detecting.  window is the n-sample ring buffer of renormalized
+	 * samples, which the caller keeps updating in place.  limit is the
+	 * distance from the calibrated mean that counts as movement.
+	 */
+	virtual void calibrate(const struct xyz *window, int n, float limit) = 0;
+	/*
+	 * Account for sample *p, which was just written to the window in place
+	 * of *evicted.  Returns true if movement is detected.
+	 */
+	virtual bool update(const struct xyz *p, const struct xyz *evicted) = 0;
+	/*
+	 * Account for the k samples in *p at once, which are about to be written
+	 * to the window in order from slot first on (wrapping around), with k no
+	 * more than the window.  Writes what update() would have returned for
+	 * each sample to moved, and magnitude() after it to magnitudes, exactly
+	 * as k calls to update() would.  Returns false, having done nothing, if
+	 * the detector only takes one sample at a time: then write each sample
+	 * to the window and update() it.
+	 */
+	virtual bool update_block(const struct xyz_block *p, int first, int k, bool *moved,
+			float *magnitudes) {
+		return false;
+	}
+	/*
+	 * Return the current distance from the calibrated mean, as compared
+	 * against limit by the last update()
+	 */
+	virtual float magnitude() = 0;
+};
+
+/*
+ * A detector that works directly on raw accelerometer readings, with no
+ * floating point per sample.  The window is not renormalized: the detector
+ * keeps the calibrated sum itself.
+ */
+class RawDetector {
+public:
+	virtual ~RawDetector() {}
+
+	/*
+	 * Start detecting.  window is the n-sample ring buffer of raw readings,
+	 * which the caller keeps updating in place.  threshold is the distance
+	 * from the calibrated mean that counts as movement, as a fraction of
+	 * the calibrated mean's magnitude.  Writes the calibrated mean, in ticks,
+	 * to *mean.
+	 */
+	virtual void calibrate(const struct xyz_raw *window, int n, float threshold,
+			struct xyz *mean) = 0;
+	/*
+	 * Account for reading *p, which was just written to the window in place
+	 * of *evicted.  Returns true if movement is detected.
+	 */
+	virtual bool update(const struct xyz_raw *p, const struct xyz_raw *evicted) = 0;
+	/*
+	 * Move the calibrated mean to *mean, in ticks, keeping the threshold, as
+	 * the baseline is tracked
+	 */
+	virtual void recenter(const struct xyz *mean) = 0;
+	/*
+	 * Return the current distance from the calibrated mean as a fraction of
+	 * the calibrated mean's magnitude, as compared against threshold by the
+	 * last update()
+	 */
+	virtual float deviation() = 0;
+};
+
+/*
+ * A band of vibration frequencies, in Hz
+ */
+struct band {
+	float low_hz;
+	float high_hz;
+};
+
+/*
+ * Names accepted by make_detector(), make_raw_detector() and
+ * make_band_detector(), for help text
+ */
+extern const char *detector_names;
+
+/*
+ * Largest window a RawDetector can handle without overflowing its sums
+ */
+#define RAW_DETECTOR_MAX_WINDOW 16384
+/*
+ * Most DFT bins a band detector updates per sample, across all its bands, so
+ * the cost per sample stays fixed at any ODR and window.  Bands that would
+ * need more are watched through a shorter DFT, with coarser bins.
+ */
+#define BAND_DETECTOR_MAX_BINS 32
+
+/*
+ * Create the detector called name, or return NULL if there isn't one:
+ * boxcar: mean of the window, rescanned every sample (the original detector)
+ * sum: mean of the window from running sums, resynced every window
+ * welford: running mean like sum, plus a running variance that also
+ * 		triggers if the spread grows by more than limit over calibration
+ * ewma: exponentially weighted moving average with the span of the window
+ */
+Detector *make_detector(const std::string &name);
+/*
+ * Create the raw detector called name, or return NULL if there isn't one:
+ * int: the sum detector in integer arithmetic, comparing squared distances
+ * 		so there's no sqrt
+ */
+RawDetector *make_raw_detector(const std::string &name);
+/*
+ * Create the band detector, which is the only one that needs more than a
+ * name: the vibration energy in each of the n bands (which it copies, at
+ * most BAND_DETECTOR_MAX_BINS) of samples at odr_hz, from a sliding DFT over
+ * the window.  Each DFT bin holds all three axes in one vector.  The distance
+ * from the calibrated mean is how far the amplitude (g) of the vibration in
+ * any band has grown since calibration.
+ */
+Detector *make_band_detector(const struct band *bands, int n, float odr_hz);
+/*
+ * Return how many DFT bins band *b has with a window of n samples at odr_hz,
+ * before BAND_DETECTOR_MAX_BINS; 0 means the band can't be watched
+ */
+int band_bins(const struct band *b, int n, float odr_hz);
+
+#endif // __DETECTOR_H__
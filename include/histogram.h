@@ -0,0 +1,51 @@
+/*
+ * histogram.h
+ *
+ * Log-bucketed histograms of durations in nanoseconds.  Each power of two is
+ * split into HISTOGRAM_SUB_BUCKETS buckets, so a bucket is at most 12.5% wide
+ * and any int64_t fits.  Recording is lock-free and wait-free apart from the
+ * min/max updates, so one thread can record while another (or a signal-driven
+ * dump) reads.
+ */
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+/*
+ * A histogram.  Zero-initialized (e.g. static) histograms are empty.
+ */
+struct histogram {
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+	uint64_t count;
+	int64_t sum;
+	int64_t min;
+	int64_t max;
+};
+
+/*
+ * Record ns in *h.  Negative values are recorded as zero.
+ */
+void histogram_record(struct histogram *h, int64_t ns);
+/*
+ * Return the highest value in the bucket holding the p-quantile (0-1) of
+ * *h, clamped to the recorded minimum and maximum, or 0 if *h is empty
+ */
+int64_t histogram_percentile(struct histogram *h, double p);
+/*
+ * Empty *h
+ */
+void histogram_reset(struct histogram *h);
+/*
+ * Print a summary line for *h as name, followed by one indented
+ * "lowest count" line for every non-empty bucket
+ */
+void histogram_print(FILE *f, const char *name, struct histogram *h);
+
+#endif // __HISTOGRAM_H__
@@ -0,0 +1,46 @@
+/*
+ * i2c_bus.h
+ *
+ * The I2C operations the LSM9DS0 driver needs from a bus, so the driver can
+ * run on real hardware through mraa or against a simulated device
+ */
+
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+#include <stdint.h>
+
+/*
+ * One device on an I2C bus.  Every call is one bus transaction.  Register
+ * addresses with bit 7 set auto-increment through consecutive registers.
+ */
+class I2cBus {
+public:
+	virtual ~I2cBus() {}
+
+	/*
+	 * Read the register reg
+	 */
+	virtual uint8_t readReg(uint8_t reg) = 0;
+	/*
+	 * Read length bytes starting at register reg into data.  Returns the
+	 * number of bytes read.
+	 */
+	virtual int readBytesReg(uint8_t reg, uint8_t *data, int length) = 0;
+	/*
+	 * Write data to the register reg
+	 */
+	virtual void writeReg(uint8_t reg, uint8_t data) = 0;
+	/*
+	 * Write length raw bytes: a register address, then the data
+	 */
+	virtual void write(const uint8_t *data, int length) = 0;
+	/*
+	 * Clock the bus at hz, e.g. 100000 for standard mode or 400000 for fast
+	 * mode.  The speed is the bus's, so it applies to every device on it.
+	 * Returns false if the bus can't run at that speed.
+	 */
+	virtual bool setSpeed(int hz) = 0;
+};
+
+#endif // __I2C_BUS_H__
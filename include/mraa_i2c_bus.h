@@ -0,0 +1,30 @@
+/*
+ * mraa_i2c_bus.h
+ *
+ * I2cBus on real hardware, through Intel's mraa library
+ */
+
+#ifndef __MRAA_I2C_BUS_H__
+#define __MRAA_I2C_BUS_H__
+
+#include "mraa.hpp"
+#include "i2c_bus.h"
+
+class MraaI2cBus : public I2cBus {
+public:
+	/*
+	 * Talk to the device at address on I2C bus number bus
+	 */
+	MraaI2cBus(int bus, uint8_t address);
+
+	uint8_t readReg(uint8_t reg);
+	int readBytesReg(uint8_t reg, uint8_t *data, int length);
+	void writeReg(uint8_t reg, uint8_t data);
+	void write(const uint8_t *data, int length);
+	bool setSpeed(int hz);
+
+private:
+	mraa::I2c i2c;
+};
+
+#endif // __MRAA_I2C_BUS_H__
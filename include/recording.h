@@ -0,0 +1,136 @@
+/*
+ * recording.h
+ *
+ * Raw accelerometer samples recorded to a fixed-size ring file.  The file is
+ * a header followed by a ring of samples, and is written through a shared
+ * mapping, so recording a sample is a couple of stores: no syscalls, and
+ * the kernel writes the pages back on its own.  recorder_sync() asks it to
+ * now and then, so little is lost if the board goes down.  Recordings are
+ * read back through a mapping too.
+ */
+
+#ifndef __RECORDING_H__
+#define __RECORDING_H__
+
+#include <stdint.h>
+
+#include "xyz.h"
+
+#define RECORD_MAGIC "STILLREC"
+#define RECORD_VERSION 2
+/*
+ * Devices whose calibration the header has room for
+ */
+#define RECORD_MAX_DEVICES 8
+/*
+ * Bands the header has room for, as many as a band detector can watch
+ */
+#define RECORD_MAX_BANDS 32
+/*
+ * Sample status bits: STATUS_REG_A's ZYXDA and ZYXOR, so
+ * LSM9DS0::accelStatusNewData() and accelStatusOverflow() decode them
+ */
+#define RECORD_STATUS_NEW 0x08
+#define RECORD_STATUS_OVERFLOW 0x80
+/*
+ * How often recorder_sync() writes the mapping back
+ */
+#define RECORD_SYNC_NS 1000000000LL
+
+/*
+ * A device's calibrated mean (g), once it has one
+ */
+struct record_calibration {
+	float x, y, z;
+	uint32_t calibrated;
+};
+
+/*
+ * A frequency band of the band detector, in Hz
+ */
+struct record_band {
+	float low_hz, high_hz;
+};
+
+/*
+ * The start of a recording
+ */
+struct record_header {
+	char magic[8];			// RECORD_MAGIC, not NUL-terminated
+	uint32_t version;		// RECORD_VERSION
+	uint32_t header_size;	// sizeof(struct record_header), where the ring starts
+	uint32_t capacity;		// samples the ring holds
+	uint32_t devices;		// devices recorded
+	float odr_hz;			// accelerometer output data rate
+	float scale_g;			// accelerometer full scale (g)
+	float g_per_lsb;		// g's per raw accelerometer tick
+	float threshold;		// still's --threshold, --buffer and --discard
+	uint32_t buffer;
+	uint32_t discard_ms;
+	char detector[12];		// still's --detector, NUL-terminated
+	uint32_t bands;			// and its --bands
+	struct record_band band[RECORD_MAX_BANDS];
+	int64_t start_ns;		// still's clock when sampling started
+	struct record_calibration calibration[RECORD_MAX_DEVICES];
+	volatile uint64_t written;	// samples ever recorded; the newest is at (written - 1) % capacity
+};
+
+/*
+ * A recorded sample
+ */
+struct record_sample {
+	int64_t t_ns;		// when the sample was taken, on still's clock
+	int16_t x, y, z;	// raw accelerometer reading
+	uint8_t status;		// RECORD_STATUS_NEW, and RECORD_STATUS_OVERFLOW if samples were lost before its batch
+	uint8_t device;		// index of the device
+};
+
+/*
+ * A recording being written
+ */
+struct recorder {
+	struct record_header *header;
+	struct record_sample *ring;
+	uint32_t capacity;
+	uint64_t written;		// header->written, without rereading the mapping
+	size_t size;			// of the mapping
+	int64_t synced_ns;		// when recorder_sync() last wrote the mapping back
+};
+
+/*
+ * Create (or replace) path to hold a ring of capacity samples, map it, and
+ * write *h to it with the magic, version, sizes and counters filled in.
+ * Returns NULL, with errno set, on failure.
+ */
+struct recorder *recorder_create(const char *path, uint32_t capacity,
+		const struct record_header *h);
+/*
+ * Record raw sample *p of device at t_ns with status
+ */
+void recorder_append(struct recorder *r, int device, int64_t t_ns,
+		const struct xyz_raw *p, uint8_t status);
+/*
+ * Record device's calibrated mean *mean (g)
+ */
+void recorder_calibrated(struct recorder *r, int device, const struct xyz *mean);
+/*
+ * Write the mapping back asynchronously if RECORD_SYNC_NS have passed since
+ * the last time, as of now_ns
+ */
+void recorder_sync(struct recorder *r, int64_t now_ns);
+
+/*
+ * Map the recording at path read-only.  Returns its header, which the ring
+ * follows, or NULL with errno set (EINVAL if path isn't a recording).
+ */
+const struct record_header *record_open(const char *path);
+/*
+ * Return how many samples recording h still holds
+ */
+uint64_t record_samples(const struct record_header *h);
+/*
+ * Return the i'th oldest sample recording h still holds
+ */
+const struct record_sample *record_sample(const struct record_header *h, uint64_t i);
+
+#endif // __RECORDING_H__
@@ -0,0 +1,76 @@
+/*
+ * sample_ring.h
+ *
+ * A wait-free single-producer, single-consumer ring of accelerometer sample
+ * batches, from the thread that samples an I2C bus to the thread that runs
+ * the detectors and the trigger.  The producer never waits: when the ring is
+ * full, the batch is dropped and counted instead.
+ */
+
+#ifndef __SAMPLE_RING_H__
+#define __SAMPLE_RING_H__
+
+#include <stdint.h>
+
+#include "SFE_LSM9DS0.h"
+#include "xyz.h"
+
+/*
+ * Samples read from one device in one go
+ */
+struct sample_batch {
+	int device;		// index of the device, or -1 when a bus stops sampling
+	int n;			// samples
+	bool overflow;	// did the device (or the ring) drop samples before these?
+	int64_t ready_ns;	// when the bus's thread came to read it, with --latency
+	int64_t read_ns;	// when the batch was read, on the bus's clock
+	int64_t dequeued_ns;	// when the detection thread took it off the ring, with --latency
+	float celsius;		// the device's temperature, read with the batch, or NAN
+	struct xyz_raw samples[LSM9DS0::ACCEL_FIFO_DEPTH];
+};
+
+class SampleRing {
+public:
+	/*
+	 * Hold up to capacity batches, rounded up to a power of two, allocated
+	 * once up front
+	 */
+	SampleRing(int capacity);
+	~SampleRing();
+
+	/*
+	 * Producer: append a copy of *b.  Returns false, and counts an overrun,
+	 * if the ring is full.
+	 */
+	bool push(const struct sample_batch *b);
+	/*
+	 * Producer: is there no room for another batch?
+	 */
+	bool full();
+	/*
+	 * Consumer: remove the oldest batch into *b.  Returns false if the ring
+	 * is empty.
+	 */
+	bool pop(struct sample_batch *b);
+
+	/*
+	 * Batches, and the samples in them, dropped because the ring was full
+	 */
+	uint64_t overruns();
+	uint64_t overrunSamples();
+	/*
+	 * The most batches the ring has held at once
+	 */
+	uint32_t highWater();
+
+private:
+	struct sample_batch *batches;
+	uint32_t mask;
+	// only the producer writes tail, only the consumer head; both count up
+	// forever and wrap through mask
+	uint32_t head, tail;
+	uint64_t overrun_count, overrun_samples;
+	uint32_t high_water;
+};
+
+#endif // __SAMPLE_RING_H__
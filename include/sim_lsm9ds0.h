@@ -0,0 +1,199 @@
+/*
+ * sim_lsm9ds0.h
+ *
+ * A simulated LSM9DS0 on a virtual clock, for running and benchmarking still
+ * without an Edison.  It models the registers still and the driver use:
+ * control registers, accelerometer STATUS/OUT/FIFO, the inertial interrupt
+ * generators and the INT1_XM/INT2_XM pins, plus gyroscope, magnetometer and
+ * temperature outputs.  Samples are generated at the configured ODR from
+ * gravity, Gaussian noise and injected motion.  Every bus transaction costs
+ * virtual time according to the bus speed, and nothing ever sleeps for real.
+ */
+
+#ifndef __SIM_LSM9DS0_H__
+#define __SIM_LSM9DS0_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "i2c_bus.h"
+
+class SimLSM9DS0 {
+public:
+	/*
+	 * Sensors motion can be injected into
+	 */
+	enum sensor {
+		ACCEL,	// g
+		GYRO,	// degrees per second
+		MAG,	// gauss
+	};
+
+	/*
+	 * Interrupt pins that can be waited on
+	 */
+	enum pin {
+		INT1_XM = 1,
+		INT2_XM = 2,
+	};
+
+	/*
+	 * Start with the devices in their power-on state, gravity along +z, and
+	 * the clock at zero.  seed makes the noise repeatable.  If busPeer is
+	 * given, this LSM9DS0 sits on the same bus as busPeer and shares its
+	 * virtual clock, so transactions on either take time from both.
+	 */
+	SimLSM9DS0(uint32_t seed = 1, SimLSM9DS0 *busPeer = NULL);
+	~SimLSM9DS0();
+
+	/*
+	 * The gyroscope's and accel/mag's buses, to hand to LSM9DS0
+	 */
+	I2cBus *gyroBus();
+	I2cBus *xmBus();
+
+	/*
+	 * Return the virtual time in nanoseconds.  Only the thread driving the
+	 * simulator moves it, but any thread may read it.
+	 */
+	int64_t now();
+	/*
+	 * Advance the virtual time by ns nanoseconds
+	 */
+	void sleep(int64_t ns);
+	/*
+	 * Advance the virtual time until pin p rises, or until timeout_ns have
+	 * passed.  Like a real edge-triggered GPIO, a pin that is already high
+	 * doesn't count.  Returns true if the pin rose.
+	 */
+	bool waitInterrupt(pin p, int64_t timeout_ns);
+
+	/*
+	 * Charge each transaction the time it would take on a bus running at hz
+	 * (9 bits per byte, plus the address and register bytes).  0 makes
+	 * transactions free.  The default is 100 kHz, mraa's standard mode.
+	 */
+	void setBusSpeed(int hz);
+	/*
+	 * Set the standard deviation of the Gaussian noise added to every axis
+	 * of a sensor, in the sensor's units
+	 */
+	void setNoise(sensor s, float sigma);
+	/*
+	 * Set the steady reading of a sensor, e.g. gravity for the accelerometer
+	 */
+	void setBaseline(sensor s, float x, float y, float z);
+	/*
+	 * Set the temperature in degrees C, as read through OUT_TEMP_L_XM
+	 */
+	void setTemperature(float celsius);
+	/*
+	 * Change the temperature by celsius_per_s every second from now on
+	 */
+	void setTemperatureRate(float celsius_per_s);
+	/*
+	 * Offset a sensor's readings by x, y and z (in the sensor's units) for
+	 * every degree C away from 25, like its zero level drifts with temperature
+	 */
+	void setTemperatureCoefficient(sensor s, float x, float y, float z);
+	/*
+	 * Add amplitude (in the sensor's units) to one axis (0-2) of a sensor from
+	 * start_ns for duration_ns.  A frequency_hz of 0 is a step, otherwise
+	 * it's a sine wave starting at 0.
+	 */
+	void addMotion(sensor s, int axis, int64_t start_ns, int64_t duration_ns,
+			float amplitude, float frequency_hz = 0);
+
+	/*
+	 * Bus transactions so far, across both devices
+	 */
+	uint64_t transactions();
+	/*
+	 * Accelerometer samples generated so far
+	 */
+	uint64_t accelSamples();
+	/*
+	 * Accelerometer samples lost so far, overwritten before being read or
+	 * dropped from a full FIFO
+	 */
+	uint64_t accelSamplesLost();
+
+private:
+	class Bus;
+	struct motion {
+		sensor s;
+		int axis;
+		int64_t start;
+		int64_t duration;
+		float amplitude;
+		float frequency;
+	};
+
+	Bus *gyro;
+	Bus *xm;
+
+	int64_t ownClock;
+	int64_t &clock;	// ownClock, or the bus peer's; stored atomically, for now()
+	int bus_hz;
+	uint64_t transaction_count;
+
+	uint8_t gRegs[0x40];
+	uint8_t xmRegs[0x40];
+
+	float noise[3];
+	float baseline[3][3];
+	// temperature at tempStart, its rate of change, and each sensor's offset per degree
+	float temp, tempRate;
+	int64_t tempStart;
+	float tempCoefficient[3][3];
+	std::vector<motion> motions;
+	uint64_t rng;
+
+	// time of the next sample of each sensor
+	int64_t gNext, aNext, mNext;
+
+	uint64_t aSamples, aLost;
+	// unread output registers, and outputs overwritten while unread
+	bool aUnread, gUnread, mUnread;
+	bool aOverrun, gOverrun, mOverrun;
+
+	// the accelerometer FIFO, as raw x, y, z
+	int16_t fifo[32][3];
+	int fifoHead, fifoCount;
+	bool fifoOverrun;
+
+	// interrupt generator state: high-pass filter, duration counters, sources
+	float hpfLow[3];
+	bool hpfPrimed;
+	int intGenCount[2];
+	uint8_t intGenSrc[2];
+
+	friend class Bus;
+
+	uint8_t read(bool isGyro, uint8_t reg);
+	void write(bool isGyro, uint8_t reg, uint8_t data);
+	uint8_t nextReg(bool isGyro, uint8_t reg);
+	void transaction(int bytes);
+	void clockBytes(int bytes);
+
+	void catchUp();
+	int64_t accelPeriod();
+	int64_t gyroPeriod();
+	int64_t magPeriod();
+	void accelSample(int64_t t);
+	void gyroSample(int64_t t);
+	void magSample(int64_t t);
+	void intGen(int n, const int16_t *raw);
+	float sample(sensor s, int axis, int64_t t);
+	float temperature(int64_t t);
+	float gaussian();
+	float spare;
+	bool haveSpare;
+
+	bool fifoEnabled();
+	uint8_t fifoSource();
+	bool pinLevel(pin p);
+};
+
+#endif // __SIM_LSM9DS0_H__
@@ -0,0 +1,113 @@
+/*
+ * state.h
+ *
+ * still's latest state, published through a shared mapping (e.g. under
+ * /dev/shm) for readers in other processes: every device's latest
+ * calibrated sample, a short history of them and running statistics, plus
+ * the trigger's latest decision.  still writes it under a seqlock, a counter
+ * that is odd while a write is under way, so it never waits for a reader and
+ * readers never make a syscall: they copy what they need and retry if a
+ * write overlapped the copy.
+ */
+
+#ifndef __STATE_H__
+#define __STATE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "xyz.h"
+
+#define STATE_MAGIC "STILLSHM"
+#define STATE_VERSION 1
+/*
+ * Devices the state has room for
+ */
+#define STATE_MAX_DEVICES 8
+/*
+ * Samples of history kept for each device, a power of two
+ */
+#define STATE_HISTORY 256
+
+/*
+ * A calibrated sample
+ */
+struct state_sample {
+	int64_t t_ns;		// when it was taken, on still's clock
+	float x, y, z;		// g
+	float deviation;	// from the calibrated mean, as a fraction of its magnitude,
+						// or NAN if the detector didn't decide on it
+};
+
+/*
+ * A device's state
+ */
+struct state_device {
+	uint32_t calibrated;
+	float magnitude;			// of the calibrated mean (g)
+	struct xyz mean;			// calibrated mean (g), as tracked with --track
+	uint64_t samples;			// samples published
+	uint64_t overflows;			// batches that followed lost samples
+	uint64_t decided;			// samples the detector decided on
+	float deviation_mean;		// over them
+	float deviation_max;
+	struct state_sample latest;
+	uint64_t written;			// samples ever added to history; the newest is at (written - 1) % STATE_HISTORY
+	struct state_sample history[STATE_HISTORY];
+};
+
+/*
+ * The whole mapping
+ */
+struct still_state {
+	char magic[8];			// STATE_MAGIC, not NUL-terminated
+	uint32_t version;		// STATE_VERSION
+	uint32_t size;			// sizeof(struct still_state)
+	uint32_t devices;		// devices published
+	uint32_t pid;			// of still
+	float odr_hz;			// accelerometer output data rate
+	float threshold;		// still's --threshold
+	uint32_t seq;			// the seqlock: odd while still is writing
+	// the trigger's latest decision
+	uint32_t moved;			// did it see movement or an overflow?
+	uint32_t device;		// the device it was about: the last to move, with several
+	float deviation;		// its deviation
+	int64_t decided_ns;		// when it was made
+	uint64_t triggers;		// decisions that saw movement or an overflow
+	int64_t triggered_ns;	// the latest of them, or -1
+	struct state_device device_state[STATE_MAX_DEVICES];
+};
+
+/*
+ * Create (or replace) path, map it, and initialize it from *s with the
+ * magic, version, size and counters filled in.  Returns the mapping, or NULL
+ * with errno set on failure.
+ */
+struct still_state *state_create(const char *path, const struct still_state *s);
+/*
+ * Start and finish a write; the other writes go between the two
+ */
+void state_begin(struct still_state *s);
+void state_end(struct still_state *s);
+/*
+ * Make *p device d's latest sample, add it to its history and statistics
+ */
+void state_append(struct still_state *s, int d, const struct state_sample *p);
+/*
+ * Record a decision of the trigger on device d at now_ns
+ */
+void state_decision(struct still_state *s, int d, bool moved, float deviation,
+		int64_t now_ns);
+
+/*
+ * Map the state at path read-only.  Returns it, or NULL with errno set
+ * (EINVAL if path isn't still's state).
+ */
+const struct still_state *state_open(const char *path);
+/*
+ * Copy the n bytes at src, a part of s, to dst as of one moment, retrying
+ * while still writes.  Copy only what's needed: the whole state is large.
+ */
+void state_read(const struct still_state *s, void *dst, const void *src, size_t n);
+
+#endif // __STATE_H__
@@ -0,0 +1,89 @@
+/*
+ * stream.h
+ *
+ * Raw accelerometer samples streamed to any number of local subscribers over
+ * a Unix domain socket, so one process owns the LSM9DS0 and every other tool
+ * shares its samples.  The socket is SOCK_SEQPACKET, so every frame arrives
+ * whole: a subscriber first gets a stream_hello, then a stream_frame followed
+ * by its samples for every batch read.  Frames are sent without waiting; a
+ * subscriber that falls so far behind that its socket buffer fills up is
+ * disconnected instead of ever holding up sampling.
+ */
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdint.h>
+
+#include "xyz.h"
+
+#define STREAM_MAGIC "STILLSTR"
+#define STREAM_VERSION 1
+/*
+ * Subscribers streamed to at once; more are turned away
+ */
+#define STREAM_MAX_SUBSCRIBERS 16
+/*
+ * How often streamer_publish() looks for new subscribers
+ */
+#define STREAM_ACCEPT_NS 100000000LL
+/*
+ * Socket buffer per subscriber: how far behind it may fall, in bytes
+ */
+#define STREAM_SNDBUF 262144
+
+/*
+ * The first frame every subscriber gets
+ */
+struct stream_hello {
+	char magic[8];			// STREAM_MAGIC, not NUL-terminated
+	uint32_t version;		// STREAM_VERSION
+	uint32_t devices;		// devices streamed
+	float odr_hz;			// accelerometer output data rate
+	float scale_g;			// accelerometer full scale (g)
+	float g_per_lsb;		// g's per raw accelerometer tick
+	uint32_t reserved;
+};
+
+/*
+ * The start of the frame for every batch read, followed by n xyz_raw samples
+ */
+struct stream_frame {
+	uint64_t seq;		// batches published before this one, so dropped frames show
+	int64_t read_ns;	// when the batch was read, on still's clock; the samples
+						// were taken one ODR period apart up to it
+	uint32_t device;	// index of the device
+	uint16_t n;			// samples that follow
+	uint8_t status;		// RECORD_STATUS_NEW, and RECORD_STATUS_OVERFLOW if samples were lost before the batch
+	uint8_t reserved;
+};
+
+/*
+ * A socket being streamed to
+ */
+struct streamer {
+	int listen_fd;
+	int fds[STREAM_MAX_SUBSCRIBERS];	// the first subscribers are connected
+	int subscribers;
+	struct stream_hello hello;
+	uint64_t seq;
+	int64_t accepted_ns;	// when streamer_publish() last looked for subscribers
+	uint64_t served;		// subscribers ever accepted
+	uint64_t dropped;		// subscribers disconnected for falling behind
+};
+
+/*
+ * Listen on path, replacing any socket already there, and greet every
+ * subscriber with *h, its magic and version filled in.  Returns NULL, with
+ * errno set, on failure.
+ */
+struct streamer *streamer_create(const char *path, const struct stream_hello *h);
+/*
+ * Send the n raw samples p of device, read at read_ns with status, to every
+ * subscriber, accepting new ones if STREAM_ACCEPT_NS have passed since the
+ * last time.  Never blocks.
+ */
+void streamer_publish(struct streamer *s, int device, const struct xyz_raw *p, int n,
+		uint8_t status, int64_t read_ns);
+
+#endif // __STREAM_H__
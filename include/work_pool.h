@@ -0,0 +1,54 @@
+/*
+ * work_pool.h
+ *
+ * A pool of threads that work through a range of independent tasks.  Every
+ * thread starts with an equal slice of the range and, once its own slice is
+ * done, steals half of what's left of another's, so uneven tasks still keep
+ * every thread busy until the end.
+ */
+
+#ifndef __WORK_POOL_H__
+#define __WORK_POOL_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+class WorkPool {
+public:
+	/*
+	 * Run tasks on threads threads
+	 */
+	WorkPool(int threads);
+	~WorkPool();
+
+	/*
+	 * Call fn(task, arg) for every task from 0 to tasks - 1, in parallel, and
+	 * return once they have all returned.  fn must be safe to call from any
+	 * thread at once for different tasks.
+	 */
+	void run(uint64_t tasks, void (*fn)(uint64_t task, void *arg), void *arg);
+	/*
+	 * Slices stolen by the last run()
+	 */
+	uint64_t steals();
+
+private:
+	struct worker {
+		WorkPool *pool;
+		pthread_t thread;
+		pthread_mutex_t lock;	// guards next and end
+		uint64_t next, end;	// the tasks left in this worker's slice
+		uint64_t steals;
+	};
+
+	struct worker *workers;
+	int threads;
+	void (*fn)(uint64_t task, void *arg);
+	void *arg;
+
+	static void *work(void *w);
+	bool take(struct worker *w, uint64_t *task);
+	bool steal(struct worker *w);
+};
+
+#endif // __WORK_POOL_H__
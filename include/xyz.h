@@ -0,0 +1,107 @@
+/*
+ * xyz.h
+ *
+ * (x,y,z) coordinates and the arithmetic still does on them
+ */
+
+#ifndef __XYZ_H__
+#define __XYZ_H__
+
+#include <stdint.h>
+
+/*
+ * A simple (x,y,z) coordinate
+ */
+struct xyz {
+	float x;
+	float y;
+	float z;
+};
+
+/*
+ * A raw (x,y,z) accelerometer reading, in ADC ticks
+ */
+struct xyz_raw {
+	int16_t x;
+	int16_t y;
+	int16_t z;
+};
+
+/*
+ * Samples in an xyz_block: a full accelerometer FIFO
+ */
+#define XYZ_BLOCK_SIZE 32
+
+/*
+ * Up to XYZ_BLOCK_SIZE coordinates stored axis by axis (structure of arrays)
+ * rather than as an array of struct xyz, so the xyz_block kernels below work
+ * on four samples per instruction.  Batches of samples (FIFO drains, replays)
+ * go through the detectors as blocks.  Declare them zeroed (= {}): a batch
+ * fills only its first samples, and the lanes past it must not be garbage.
+ */
+struct xyz_block {
+	float x[XYZ_BLOCK_SIZE] __attribute__((aligned(16)));
+	float y[XYZ_BLOCK_SIZE] __attribute__((aligned(16)));
+	float z[XYZ_BLOCK_SIZE] __attribute__((aligned(16)));
+};
+
+/*
+ * The xyz_block kernels compiled in: "ssse3", "sse2" or "scalar", chosen at
+ * build time from the instruction set the compiler targets.  Every kernel
+ * gives the same result for a sample as the scalar code does, wherever the
+ * sample falls in a block, as long as floating point is done in SSE
+ * registers (-mfpmath=sse on 32-bit x86) and multiply-adds aren't fused
+ * (-ffp-contract=off where the target has FMA).
+ */
+extern const char *xyz_block_kernels;
+
+/*
+ * Add the coordinate values *q to those in *p, returning p
+ */
+struct xyz *xyz_add(struct xyz *p, const struct xyz *q);
+/*
+ * Subtract the coordinate values *q from this in *p, returning p
+ */
+struct xyz *xyz_subtract(struct xyz *p, const struct xyz *q);
+/*
+ * Write the mean coordinate values of the n-length array starting
+ * with *q into *p, returning p
+ */
+struct xyz *xyz_mean(struct xyz *p, const struct xyz *q, int n);
+/*
+ * Return the magnitude of *p
+ */
+float xyz_magnitude(const struct xyz *p);
+
+/*
+ * Write the k raw readings starting with *q into *b, scaled by scale and
+ * less *mean (the calibration subtraction), returning b
+ */
+struct xyz_block *xyz_block_from_raw(struct xyz_block *b, const struct xyz_raw *q, int k,
+		float scale, const struct xyz *mean);
+/*
+ * Write the k coordinates from slot first of the n-length ring buffer *ring
+ * (wrapping around) into *b, returning b
+ */
+struct xyz_block *xyz_block_load(struct xyz_block *b, const struct xyz *ring, int n,
+		int first, int k);
+/*
+ * Write the first k coordinates of *b to the n-length ring buffer *ring,
+ * from slot first on (wrapping around)
+ */
+void xyz_block_store(const struct xyz_block *b, struct xyz *ring, int n, int first, int k);
+/*
+ * Slide samples from to to-1 of *p into an n-sample window in place of those
+ * of *evicted, one at a time: add each to the running window sums (x, y, z)
+ * and subtract its evicted sample, then write the window mean to *means.  The
+ * sums are double precision and accumulate in sample order, like a scalar
+ * loop's would.  Returns means.
+ */
+struct xyz_block *xyz_block_window_means(struct xyz_block *means, const struct xyz_block *p,
+		const struct xyz_block *evicted, int from, int to, int n, double *sums);
+/*
+ * Write the magnitudes of the first k coordinates of *b to m
+ */
+void xyz_block_magnitudes(const struct xyz_block *b, int k, float *m);
+
+#endif // __XYZ_H__
@@ -14,7 +14,7 @@ hardware reads and writes.
 
 Development environment specifics:
   Code developed in Intel's Eclipse IOT-DK
-  This code requires the Intel mraa library to function; for more
+  This code requires the Intel mraa library to talk to real hardware; for more
   information see https://github.com/intel-iot-devkit/mraa
 
 This code is beerware; if you see me (or any other SparkFun employee) at the
@@ -24,26 +24,52 @@ Distributed as-is; no warranty is given.
 ******************************************************************************/
 
 #include "SFE_LSM9DS0.h"
-#include <mraa.h>
+#ifndef NO_MRAA
+#include "mraa_i2c_bus.h"
+#endif
 #include <stdint.h>
 #include <unistd.h>
 
-LSM9DS0::LSM9DS0(uint8_t gAddr, uint8_t xmAddr):
+#ifndef NO_MRAA
+LSM9DS0::LSM9DS0(uint8_t gAddr, uint8_t xmAddr, int bus):
   gx(0), gy(0), gz(0),
   ax(0), ay(0), az(0),
   mx(0), my(0), mz(0),
   temperature(0),
   gScale(G_SCALE_245DPS), aScale(A_SCALE_4G), mScale(M_SCALE_2GS),
-  gRes(0), aRes(0), mRes(0)
+  gRes(0), aRes(0), mRes(0),
+  initialized(0), holdCtrlWrites(false),
+  gCtrlValid(false), xmCtrlValid(false)
 {
-  gyro = new mraa::I2c(1);
-  gyro->address(gAddr);
-  xm = new mraa::I2c(1);
-  xm->address(xmAddr);
+  gyro = new MraaI2cBus(bus, gAddr);
+  xm = new MraaI2cBus(bus, xmAddr);
+}
+#endif
+
+LSM9DS0::LSM9DS0(I2cBus* gyroBus, I2cBus* xmBus):
+  gx(0), gy(0), gz(0),
+  ax(0), ay(0), az(0),
+  mx(0), my(0), mz(0),
+  temperature(0),
+  gyro(gyroBus), xm(xmBus),
+  gScale(G_SCALE_245DPS), aScale(A_SCALE_4G), mScale(M_SCALE_2GS),
+  gRes(0), aRes(0), mRes(0),
+  initialized(0), holdCtrlWrites(false),
+  gCtrlValid(false), xmCtrlValid(false)
+{
+}
+
+bool LSM9DS0::setBusSpeed(int hz)
+{
+	// Set both, even when they're the same physical bus; it's cheap.
+	bool gOk = gyro->setSpeed(hz);
+	bool xmOk = xm->setSpeed(hz);
+	return gOk && xmOk;
 }
 
 uint16_t LSM9DS0::begin(gyro_scale gScl, accel_scale aScl, mag_scale mScl, 
-						gyro_odr gODR, accel_odr aODR, mag_odr mODR)
+						gyro_odr gODR, accel_odr aODR, mag_odr mODR,
+						accel_abw aABW, uint8_t sensors)
 {
 	// Store the given scales in class variables. These scale variables
 	// are used throughout to calculate the actual g's, DPS,and Gs's.
@@ -58,29 +84,80 @@ uint16_t LSM9DS0::begin(gyro_scale gScl, accel_scale aScl, mag_scale mScl,
 	calcaRes(); // Calculate g / ADC tick, stored in aRes variable
 	
 	// To verify communication, we can read from the WHO_AM_I register of
-	// each device. Store those in a variable so we can return them.
-	uint8_t gTest = gReadByte(WHO_AM_I_G);		// Read the gyro WHO_AM_I
-	uint8_t xmTest = xmReadByte(WHO_AM_I_XM);	// Read the accel/mag WHO_AM_I
-	
-	// Gyro initialization stuff:
-	initGyro();	// This will "turn on" the gyro. Setting up interrupts, etc.
-	setGyroODR(gODR); // Set the gyro output data rate and bandwidth.
-	setGyroScale(gScale); // Set the gyro range
-	
-	// Accelerometer initialization stuff:
-	initAccel(); // "Turn on" all axes of the accel. Set up interrupts, etc.
-	setAccelODR(aODR); // Set the accel data rate.
-	setAccelScale(aScale); // Set the accel range.
-	
-	// Magnetometer initialization stuff:
-	initMag(); // "Turn on" all axes of the mag. Set up interrupts, etc.
-	setMagODR(mODR); // Set the magnetometer output data rate.
-	setMagScale(mScale); // Set the magnetometer's range.
-	
+	// each device we're going to use. Store those in a variable so we can
+	// return them.
+	uint8_t gTest = 0, xmTest = 0;
+	if (sensors & INIT_GYRO)
+		gTest = gReadByte(WHO_AM_I_G);		// Read the gyro WHO_AM_I
+	if (sensors & (INIT_ACCEL | INIT_MAG))
+		xmTest = xmReadByte(WHO_AM_I_XM);	// Read the accel/mag WHO_AM_I
+
+	initialized &= ~sensors; // Start over with the sensors asked for
+	initSensors(sensors, gODR, aODR, aABW, mODR);
+
 	// Once everything is initialized, return the WHO_AM_I registers we read:
 	return (xmTest << 8) | gTest;
 }
 
+void LSM9DS0::initSensors(uint8_t sensors, gyro_odr gODR, accel_odr aODR,
+						accel_abw aABW, mag_odr mODR)
+{
+	sensors &= ~initialized;
+	if (!sensors)
+		return;
+	initialized |= sensors; // So the setters below don't come back here
+
+	// Every control register of a sensor being initialized is about to be
+	// overwritten, so there's no need to read back the shadow copies:
+	if (sensors & INIT_GYRO)
+		gCtrlValid = true;
+	if ((sensors & INIT_ACCEL) && (sensors & INIT_MAG))
+		xmCtrlValid = true;
+
+	// Collect all of the settings in the shadow registers, then write each
+	// sensor's control registers in one burst:
+	holdCtrlWrites = true;
+
+	if (sensors & INIT_GYRO)
+	{
+		// Gyro initialization stuff:
+		initGyro();	// This will "turn on" the gyro. Setting up interrupts, etc.
+		setGyroODR(gODR); // Set the gyro output data rate and bandwidth.
+		setGyroScale(gScale); // Set the gyro range
+	}
+
+	if (sensors & INIT_ACCEL)
+	{
+		// Accelerometer initialization stuff:
+		initAccel(); // "Turn on" all axes of the accel. Set up interrupts, etc.
+		setAccelODR(aODR); // Set the accel data rate.
+		setAccelScale(aScale); // Set the accel range.
+		setAccelABW(aABW); // Set the accel anti-aliasing filter.
+	}
+
+	if (sensors & INIT_MAG)
+	{
+		// Magnetometer initialization stuff:
+		initMag(); // "Turn on" all axes of the mag. Set up interrupts, etc.
+		setMagODR(mODR); // Set the magnetometer output data rate.
+		setMagScale(mScale); // Set the magnetometer's range.
+	}
+
+	holdCtrlWrites = false;
+
+	// CTRL_REG1_G through CTRL_REG5_G belong to the gyro:
+	if (sensors & INIT_GYRO)
+		gWriteBytes(CTRL_REG1_G, gCtrl, 5);
+	// CTRL_REG0_XM through CTRL_REG3_XM belong to the accel, CTRL_REG4_XM
+	// through CTRL_REG7_XM to the mag:
+	if ((sensors & INIT_ACCEL) && (sensors & INIT_MAG))
+		xmWriteBytes(CTRL_REG0_XM, xmCtrl, 8);
+	else if (sensors & INIT_ACCEL)
+		xmWriteBytes(CTRL_REG0_XM, xmCtrl, 4);
+	else if (sensors & INIT_MAG)
+		xmWriteBytes(CTRL_REG4_XM, xmCtrl + 4, 4);
+}
+
 void LSM9DS0::initGyro()
 {
 	/* CTRL_REG1_G sets output data rate, bandwidth, power-down and enables
@@ -91,7 +168,7 @@ void LSM9DS0::initGyro()
 		 Value depends on ODR. See datasheet table 21.
 	PD - Power down enable (0=power down mode, 1=normal or sleep mode)
 	Zen, Xen, Yen - Axis enable (o=disabled, 1=enabled)	*/
-	gWriteByte(CTRL_REG1_G, 0x0F); // Normal mode, enable all axes
+	gWriteCtrl(CTRL_REG1_G, 0x0F); // Normal mode, enable all axes
 	
 	/* CTRL_REG2_G sets up the HPF
 	Bits[7:0]: 0 0 HPM1 HPM0 HPCF3 HPCF2 HPCF1 HPCF0
@@ -101,7 +178,7 @@ void LSM9DS0::initGyro()
 	HPCF[3:0] - High pass filter cutoff frequency
 		Value depends on data rate. See datasheet table 26.
 	*/
-	gWriteByte(CTRL_REG2_G, 0x00); // Normal mode, high cutoff frequency
+	gWriteCtrl(CTRL_REG2_G, 0x00); // Normal mode, high cutoff frequency
 	
 	/* CTRL_REG3_G sets up interrupt and DRDY_G pins
 	Bits[7:0]: I1_IINT1 I1_BOOT H_LACTIVE PP_OD I2_DRDY I2_WTM I2_ORUN I2_EMPTY
@@ -114,7 +191,7 @@ void LSM9DS0::initGyro()
 	I2_ORUN - FIFO overrun interrupt on DRDY_G (0=disable 1=enable)
 	I2_EMPTY - FIFO empty interrupt on DRDY_G (0=disable 1=enable) */
 	// Int1 enabled (pp, active low), data read on DRDY_G:
-	gWriteByte(CTRL_REG3_G, 0x88); 
+	gWriteCtrl(CTRL_REG3_G, 0x88); 
 	
 	/* CTRL_REG4_G sets the scale, update mode
 	Bits[7:0] - BDU BLE FS1 FS0 - ST1 ST0 SIM
@@ -126,7 +203,7 @@ void LSM9DS0::initGyro()
 		00=disabled, 01=st 0 (x+, y-, z-), 10=undefined, 11=st 1 (x-, y+, z+)
 	SIM - SPI serial interface mode select
 		0=4 wire, 1=3 wire */
-	gWriteByte(CTRL_REG4_G, 0x00); // Set scale to 245 dps
+	gWriteCtrl(CTRL_REG4_G, 0x00); // Set scale to 245 dps
 	
 	/* CTRL_REG5_G sets up the FIFO, HPF, and INT1
 	Bits[7:0] - BOOT FIFO_EN - HPen INT1_Sel1 INT1_Sel0 Out_Sel1 Out_Sel0
@@ -135,7 +212,7 @@ void LSM9DS0::initGyro()
 	HPen - HPF enable (0=disable, 1=enable)
 	INT1_Sel[1:0] - Int 1 selection configuration
 	Out_Sel[1:0] - Out selection configuration */
-	gWriteByte(CTRL_REG5_G, 0x00);
+	gWriteCtrl(CTRL_REG5_G, 0x00);
 	
 }
 
@@ -149,7 +226,7 @@ void LSM9DS0::initAccel()
 	HP_CLICK - HPF enabled for click (0: filter bypassed, 1: enabled)
 	HPIS1 - HPF enabled for interrupt generator 1 (0: bypassed, 1: enabled)
 	HPIS2 - HPF enabled for interrupt generator 2 (0: bypassed, 1 enabled)   */
-	xmWriteByte(CTRL_REG0_XM, 0x00);
+	xmWriteCtrl(CTRL_REG0_XM, 0x00);
 	
 	/* CTRL_REG1_XM (0x20) (Default value: 0x07)
 	Bits (7-0): AODR3 AODR2 AODR1 AODR0 BDU AZEN AYEN AXEN
@@ -162,7 +239,7 @@ void LSM9DS0::initAccel()
 		1: Output registers aren't updated until MSB and LSB have been read.
 	AZEN, AYEN, and AXEN - Acceleration x/y/z-axis enabled.
 		0: Axis disabled, 1: Axis enabled									 */	
-	xmWriteByte(CTRL_REG1_XM, 0x57); // 100Hz data rate, x/y/z all enabled
+	xmWriteCtrl(CTRL_REG1_XM, 0x57); // 100Hz data rate, x/y/z all enabled
 	
 	//Serial.println(xmReadByte(CTRL_REG1_XM));
 	/* CTRL_REG2_XM (0x21) (Default value: 0x00)
@@ -175,13 +252,13 @@ void LSM9DS0::initAccel()
 		00=normal (no self-test), 01=positive st, 10=negative st, 11=not allowed
 	SIM - SPI mode selection
 		0=4-wire, 1=3-wire													 */
-	xmWriteByte(CTRL_REG2_XM, 0x00); // Set scale to 2g
+	xmWriteCtrl(CTRL_REG2_XM, 0x00); // Set scale to 2g
 	
 	/* CTRL_REG3_XM is used to set interrupt generators on INT1_XM
 	Bits (7-0): P1_BOOT P1_TAP P1_INT1 P1_INT2 P1_INTM P1_DRDYA P1_DRDYM P1_EMPTY
 	*/
 	// Accelerometer data ready on INT1_XM (0x04)
-	xmWriteByte(CTRL_REG3_XM, 0x04); 
+	xmWriteCtrl(CTRL_REG3_XM, 0x04); 
 }
 
 void LSM9DS0::initMag()
@@ -196,13 +273,13 @@ void LSM9DS0::initMag()
 		0=interrupt request not latched, 1=interrupt request latched
 	LIR1 - Latch interrupt request on INT1_SRC (cleared by readging INT1_SRC)
 		0=irq not latched, 1=irq latched 									 */
-	xmWriteByte(CTRL_REG5_XM, 0x94); // Mag data rate - 100 Hz, enable temperature sensor
+	xmWriteCtrl(CTRL_REG5_XM, 0x94); // Mag data rate - 100 Hz, enable temperature sensor
 	
 	/* CTRL_REG6_XM sets the magnetometer full-scale
 	Bits (7-0): 0 MFS1 MFS0 0 0 0 0 0
 	MFS[1:0] - Magnetic full-scale selection
 	00:+/-2Gauss, 01:+/-4Gs, 10:+/-8Gs, 11:+/-12Gs							 */
-	xmWriteByte(CTRL_REG6_XM, 0x00); // Mag scale to +/- 2GS
+	xmWriteCtrl(CTRL_REG6_XM, 0x00); // Mag scale to +/- 2GS
 	
 	/* CTRL_REG7_XM sets magnetic sensor mode, low power mode, and filters
 	AHPM1 AHPM0 AFDS 0 0 MLP MD1 MD0
@@ -216,12 +293,12 @@ void LSM9DS0::initMag()
 		1=data rate is set to 3.125Hz
 	MD[1:0] - Magnetic sensor mode selection (default 10)
 		00=continuous-conversion, 01=single-conversion, 10 and 11=power-down */
-	xmWriteByte(CTRL_REG7_XM, 0x00); // Continuous conversion mode
+	xmWriteCtrl(CTRL_REG7_XM, 0x00); // Continuous conversion mode
 	
 	/* CTRL_REG4_XM is used to set interrupt generators on INT2_XM
 	Bits (7-0): P2_TAP P2_INT1 P2_INT2 P2_INTM P2_DRDYA P2_DRDYM P2_Overrun P2_WTM
 	*/
-	xmWriteByte(CTRL_REG4_XM, 0x04); // Magnetometer data ready on INT2_XM (0x08)
+	xmWriteCtrl(CTRL_REG4_XM, 0x04); // Magnetometer data ready on INT2_XM (0x08)
 	
 	/* INT_CTRL_REG_M to set push-pull/open drain, and active-low/high
 	Bits[7:0] - XMIEN YMIEN ZMIEN PP_OD IEA IEL 4D MIEN
@@ -239,6 +316,8 @@ void LSM9DS0::initMag()
 
 void LSM9DS0::readAccel()
 {
+	if (!(initialized & INIT_ACCEL)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_ACCEL);
 	uint8_t temp[6]; // We'll read six bytes from the accelerometer into temp	
 	xmReadBytes(OUT_X_L_A, temp, 6); // Read 6 bytes, beginning at OUT_X_L_A
 	ax = (temp[1] << 8) | temp[0]; // Store x-axis values into ax
@@ -246,8 +325,169 @@ void LSM9DS0::readAccel()
 	az = (temp[5] << 8) | temp[4]; // Store z-axis values into az
 }
 
+uint8_t LSM9DS0::readAccelWithStatus()
+{
+	if (!(initialized & INIT_ACCEL)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_ACCEL);
+	uint8_t temp[7]; // Status, then six bytes of readings
+	xmReadBytes(STATUS_REG_A, temp, 7); // Read 7 bytes, beginning at STATUS_REG_A
+	ax = (temp[2] << 8) | temp[1]; // Store x-axis values into ax
+	ay = (temp[4] << 8) | temp[3]; // Store y-axis values into ay
+	az = (temp[6] << 8) | temp[5]; // Store z-axis values into az
+	return temp[0];
+}
+
+bool LSM9DS0::accelStatusNewData(uint8_t status)
+{
+	return (status & 0b00001000) != 0; // ZYXDA
+}
+
+bool LSM9DS0::accelStatusOverflow(uint8_t status)
+{
+	return (status & 0b10000000) != 0; // ZYXOR
+}
+
+void LSM9DS0::setInt1XMSources(uint8_t sources)
+{
+	// Every bit of CTRL_REG3_XM is an INT1_XM source, so no need to preserve it
+	xmWriteCtrl(CTRL_REG3_XM, sources);
+}
+
+void LSM9DS0::setInt2XMSources(uint8_t sources)
+{
+	// Every bit of CTRL_REG4_XM is an INT2_XM source, so no need to preserve it
+	xmWriteCtrl(CTRL_REG4_XM, sources);
+}
+
+void LSM9DS0::configAccelIntGen1(uint8_t config, uint8_t threshold, uint8_t duration)
+{
+	xmWriteByte(INT_GEN_1_THS, threshold & 0x7F);
+	xmWriteByte(INT_GEN_1_DURATION, duration & 0x7F);
+	xmWriteByte(INT_GEN_1_REG, config); // Enable events last
+}
+
+void LSM9DS0::configAccelIntGen2(uint8_t config, uint8_t threshold, uint8_t duration)
+{
+	xmWriteByte(INT_GEN_2_THS, threshold & 0x7F);
+	xmWriteByte(INT_GEN_2_DURATION, duration & 0x7F);
+	xmWriteByte(INT_GEN_2_REG, config); // Enable events last
+}
+
+uint8_t LSM9DS0::accelIntGen1Source()
+{
+	return xmReadByte(INT_GEN_1_SRC);
+}
+
+uint8_t LSM9DS0::accelIntGen2Source()
+{
+	return xmReadByte(INT_GEN_2_SRC);
+}
+
+bool LSM9DS0::accelIntGenActive(uint8_t intGenSource)
+{
+	return (intGenSource & 0x40) != 0; // IA
+}
+
+void LSM9DS0::setAccelIntGenHPF(bool intGen1, bool intGen2)
+{
+	// HPIS1 is bit 1 and HPIS2 is bit 0 of CTRL_REG0_XM. Preserve the rest:
+	uint8_t temp = xmReadCtrl(CTRL_REG0_XM);
+	temp &= 0xFF^0x3;
+	temp |= (intGen1 << 1) | intGen2;
+	xmWriteCtrl(CTRL_REG0_XM, temp);
+}
+
+void LSM9DS0::latchAccelIntGen(bool intGen1, bool intGen2)
+{
+	// LIR2 is bit 1 and LIR1 is bit 0 of CTRL_REG5_XM. Preserve the rest:
+	uint8_t temp = xmReadCtrl(CTRL_REG5_XM);
+	temp &= 0xFF^0x3;
+	temp |= (intGen2 << 1) | intGen1;
+	xmWriteCtrl(CTRL_REG5_XM, temp);
+}
+
+uint8_t LSM9DS0::calcAccelIntGenThreshold(float g)
+{
+	// aRes is g / (ADC tick) over 15 bits plus sign; the threshold has 7 bits
+	int ths = (int) (g / (aRes * 256.0) + 0.5);
+	if (ths < 1)
+		return 1;
+	if (ths > 0x7F)
+		return 0x7F;
+	return ths;
+}
+
+void LSM9DS0::enableAccelFIFO(fifo_mode mode, uint8_t watermark, bool limitDepth)
+{
+	// FIFO_EN is bit 6 and WTM_EN is bit 5 of CTRL_REG0_XM. Preserve the
+	// rest of the register (BOOT, HP_CLICK, HPIS1, HPIS2):
+	uint8_t temp = xmReadCtrl(CTRL_REG0_XM);
+	temp &= 0xFF^(0x3 << 5);
+	temp |= 1 << 6;
+	if (limitDepth)
+		temp |= 1 << 5;
+	xmWriteCtrl(CTRL_REG0_XM, temp);
+
+	/* FIFO_CTRL_REG (0x2E) (Default value: 0x00)
+	Bits (7-0): FM2 FM1 FM0 WTM4 WTM3 WTM2 WTM1 WTM0
+	FM[2:0] - FIFO mode selection
+		000=bypass, 001=FIFO, 010=stream, 011=stream-to-FIFO,
+		100=bypass-to-stream
+	WTM[4:0] - FIFO watermark level										 */
+	xmWriteByte(FIFO_CTRL_REG, (mode << 5) | (watermark & 0x1F));
+}
+
+void LSM9DS0::disableAccelFIFO()
+{
+	xmWriteByte(FIFO_CTRL_REG, FIFO_BYPASS << 5);
+	uint8_t temp = xmReadCtrl(CTRL_REG0_XM);
+	temp &= 0xFF^(0x3 << 5);
+	xmWriteCtrl(CTRL_REG0_XM, temp);
+}
+
+uint8_t LSM9DS0::accelFIFOStatus()
+{
+	return xmReadByte(FIFO_SRC_REG);
+}
+
+uint8_t LSM9DS0::accelFIFOSamples(uint8_t fifoStatus)
+{
+	if (fifoStatus & 0x20) // EMPTY
+		return 0;
+	if (fifoStatus & 0x40) // OVRN: every slot is full, one more than FSS can count
+		return ACCEL_FIFO_DEPTH;
+	return fifoStatus & 0x1F; // FSS[4:0]
+}
+
+bool LSM9DS0::accelFIFOWatermark(uint8_t fifoStatus)
+{
+	return (fifoStatus & 0x80) != 0; // WTM
+}
+
+bool LSM9DS0::accelFIFOOverrun(uint8_t fifoStatus)
+{
+	return (fifoStatus & 0x40) != 0; // OVRN
+}
+
+void LSM9DS0::readAccelFIFO(int16_t * dest, uint8_t count)
+{
+	if (count == 0)
+		return;
+	if (count > ACCEL_FIFO_DEPTH)
+		count = ACCEL_FIFO_DEPTH;
+	uint8_t temp[6 * ACCEL_FIFO_DEPTH]; // Six bytes per stored sample
+	xmReadBytes(OUT_X_L_A, temp, 6 * count); // One burst for the whole batch
+	for (int i = 0; i < 3 * count; i++)
+		dest[i] = (temp[2*i + 1] << 8) | temp[2*i];
+	ax = dest[3*count - 3]; // Keep ax, ay, az as the newest sample
+	ay = dest[3*count - 2];
+	az = dest[3*count - 1];
+}
+
 void LSM9DS0::readMag()
 {
+	if (!(initialized & INIT_MAG)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_MAG);
 	uint8_t temp[6]; // We'll read six bytes from the mag into temp	
 	xmReadBytes(OUT_X_L_M, temp, 6); // Read 6 bytes, beginning at OUT_X_L_M
 	mx = (temp[1] << 8) | temp[0]; // Store x-axis values into mx
@@ -255,8 +495,22 @@ void LSM9DS0::readMag()
 	mz = (temp[5] << 8) | temp[4]; // Store z-axis values into mz
 }
 
+uint8_t LSM9DS0::readMagWithStatus()
+{
+	if (!(initialized & INIT_MAG)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_MAG);
+	uint8_t temp[7]; // Status, then six bytes of readings
+	xmReadBytes(STATUS_REG_M, temp, 7); // Read 7 bytes, beginning at STATUS_REG_M
+	mx = (temp[2] << 8) | temp[1]; // Store x-axis values into mx
+	my = (temp[4] << 8) | temp[3]; // Store y-axis values into my
+	mz = (temp[6] << 8) | temp[5]; // Store z-axis values into mz
+	return temp[0];
+}
+
 void LSM9DS0::readTemp()
 {
+	if (!(initialized & INIT_MAG)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_MAG);
 	uint8_t temp[2]; // We'll read two bytes from the temperature sensor into temp	
 	xmReadBytes(OUT_TEMP_L_XM, temp, 2); // Read 2 bytes, beginning at OUT_TEMP_L_M
 	temperature =  int16_t(temp[0]) + (int16_t(temp[1])<<8) ; // Temperature is a 12-bit signed integer
@@ -264,6 +518,8 @@ void LSM9DS0::readTemp()
 
 void LSM9DS0::readGyro()
 {
+	if (!(initialized & INIT_GYRO)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_GYRO);
 	uint8_t temp[6]; // We'll read six bytes from the gyro into temp
 	gReadBytes(OUT_X_L_G, temp, 6); // Read 6 bytes, beginning at OUT_X_L_G
 	gx = (temp[1] << 8) | temp[0]; // Store x-axis values into gx
@@ -271,6 +527,18 @@ void LSM9DS0::readGyro()
 	gz = (temp[5] << 8) | temp[4]; // Store z-axis values into gz
 }
 
+uint8_t LSM9DS0::readGyroWithStatus()
+{
+	if (!(initialized & INIT_GYRO)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_GYRO);
+	uint8_t temp[7]; // Status, then six bytes of readings
+	gReadBytes(STATUS_REG_G, temp, 7); // Read 7 bytes, beginning at STATUS_REG_G
+	gx = (temp[2] << 8) | temp[1]; // Store x-axis values into gx
+	gy = (temp[4] << 8) | temp[3]; // Store y-axis values into gy
+	gz = (temp[6] << 8) | temp[5]; // Store z-axis values into gz
+	return temp[0];
+}
+
 float LSM9DS0::calcGyro(int16_t gyro)
 {
 	// Return the gyro raw reading times our pre-calculated DPS / (ADC tick):
@@ -291,14 +559,16 @@ float LSM9DS0::calcMag(int16_t mag)
 
 void LSM9DS0::setGyroScale(gyro_scale gScl)
 {
-	// We need to preserve the other bytes in CTRL_REG4_G. So, first read it:
-	uint8_t temp = gReadByte(CTRL_REG4_G);
+	if (!(initialized & INIT_GYRO)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_GYRO);
+	// We need to preserve the other bits in CTRL_REG4_G. So, first get its shadow copy:
+	uint8_t temp = gReadCtrl(CTRL_REG4_G);
 	// Then mask out the gyro scale bits:
 	temp &= 0xFF^(0x3 << 4);
 	// Then shift in our new scale bits:
 	temp |= gScl << 4;
 	// And write the new register value back into CTRL_REG4_G:
-	gWriteByte(CTRL_REG4_G, temp);
+	gWriteCtrl(CTRL_REG4_G, temp);
 	
 	// We've updated the sensor, but we also need to update our class variables
 	// First update gScale:
@@ -309,14 +579,16 @@ void LSM9DS0::setGyroScale(gyro_scale gScl)
 
 void LSM9DS0::setAccelScale(accel_scale aScl)
 {
-	// We need to preserve the other bytes in CTRL_REG2_XM. So, first read it:
-	uint8_t temp = xmReadByte(CTRL_REG2_XM);
+	if (!(initialized & INIT_ACCEL)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_ACCEL);
+	// We need to preserve the other bits in CTRL_REG2_XM. So, first get its shadow copy:
+	uint8_t temp = xmReadCtrl(CTRL_REG2_XM);
 	// Then mask out the accel scale bits:
-	temp &= 0xFF^(0x3 << 3);
+	temp &= 0xFF^(0x7 << 3);
 	// Then shift in our new scale bits:
 	temp |= aScl << 3;
 	// And write the new register value back into CTRL_REG2_XM:
-	xmWriteByte(CTRL_REG2_XM, temp);
+	xmWriteCtrl(CTRL_REG2_XM, temp);
 	
 	// We've updated the sensor, but we also need to update our class variables
 	// First update aScale:
@@ -327,14 +599,16 @@ void LSM9DS0::setAccelScale(accel_scale aScl)
 
 void LSM9DS0::setMagScale(mag_scale mScl)
 {
-	// We need to preserve the other bytes in CTRL_REG6_XM. So, first read it:
-	uint8_t temp = xmReadByte(CTRL_REG6_XM);
+	if (!(initialized & INIT_MAG)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_MAG);
+	// We need to preserve the other bits in CTRL_REG6_XM. So, first get its shadow copy:
+	uint8_t temp = xmReadCtrl(CTRL_REG6_XM);
 	// Then mask out the mag scale bits:
 	temp &= 0xFF^(0x3 << 5);
 	// Then shift in our new scale bits:
 	temp |= mScl << 5;
 	// And write the new register value back into CTRL_REG6_XM:
-	xmWriteByte(CTRL_REG6_XM, temp);
+	xmWriteCtrl(CTRL_REG6_XM, temp);
 	
 	// We've updated the sensor, but we also need to update our class variables
 	// First update mScale:
@@ -345,50 +619,58 @@ void LSM9DS0::setMagScale(mag_scale mScl)
 
 void LSM9DS0::setGyroODR(gyro_odr gRate)
 {
-	// We need to preserve the other bytes in CTRL_REG1_G. So, first read it:
-	uint8_t temp = gReadByte(CTRL_REG1_G);
+	if (!(initialized & INIT_GYRO)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_GYRO);
+	// We need to preserve the other bits in CTRL_REG1_G. So, first get its shadow copy:
+	uint8_t temp = gReadCtrl(CTRL_REG1_G);
 	// Then mask out the gyro ODR bits:
 	temp &= 0xFF^(0xF << 4);
 	// Then shift in our new ODR bits:
 	temp |= (gRate << 4);
 	// And write the new register value back into CTRL_REG1_G:
-	gWriteByte(CTRL_REG1_G, temp);
+	gWriteCtrl(CTRL_REG1_G, temp);
 }
 
 void LSM9DS0::setAccelODR(accel_odr aRate)
 {
-	// We need to preserve the other bytes in CTRL_REG1_XM. So, first read it:
-	uint8_t temp = xmReadByte(CTRL_REG1_XM);
+	if (!(initialized & INIT_ACCEL)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_ACCEL);
+	// We need to preserve the other bits in CTRL_REG1_XM. So, first get its shadow copy:
+	uint8_t temp = xmReadCtrl(CTRL_REG1_XM);
 	// Then mask out the accel ODR bits:
 	temp &= 0xFF^(0xF << 4);
 	// Then shift in our new ODR bits:
 	temp |= (aRate << 4);
 	// And write the new register value back into CTRL_REG1_XM:
-	xmWriteByte(CTRL_REG1_XM, temp);
+	xmWriteCtrl(CTRL_REG1_XM, temp);
 }
 
 void LSM9DS0::setAccelABW(accel_abw abwRate)
 {
-	// We need to preserve the other bytes in CTRL_REG2_XM. So, first read it:
-	uint8_t temp = xmReadByte(CTRL_REG2_XM);
+	if (!(initialized & INIT_ACCEL)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_ACCEL);
+	// We need to preserve the other bits in CTRL_REG2_XM. So, first get its shadow copy:
+	uint8_t temp = xmReadCtrl(CTRL_REG2_XM);
 	// Then mask out the accel ABW bits:
 	temp &= 0xFF^(0x3 << 6);
 	// Then shift in our new ODR bits:
 	temp |= (abwRate << 6);
 	// And write the new register value back into CTRL_REG2_XM:
-	xmWriteByte(CTRL_REG2_XM, temp);
+	xmWriteCtrl(CTRL_REG2_XM, temp);
 }
 
 void LSM9DS0::setMagODR(mag_odr mRate)
 {
-	// We need to preserve the other bytes in CTRL_REG5_XM. So, first read it:
-	uint8_t temp = xmReadByte(CTRL_REG5_XM);
+	if (!(initialized & INIT_MAG)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_MAG);
+	// We need to preserve the other bits in CTRL_REG5_XM. So, first get its shadow copy:
+	uint8_t temp = xmReadCtrl(CTRL_REG5_XM);
 	// Then mask out the mag ODR bits:
 	temp &= 0xFF^(0x7 << 2);
 	// Then shift in our new ODR bits:
 	temp |= (mRate << 2);
 	// And write the new register value back into CTRL_REG5_XM:
-	xmWriteByte(CTRL_REG5_XM, temp);
+	xmWriteCtrl(CTRL_REG5_XM, temp);
 }
 
 void LSM9DS0::calcgRes()
@@ -430,6 +712,8 @@ void LSM9DS0::calcmRes()
 
 bool LSM9DS0::newXData()
 {
+	if (!(initialized & INIT_ACCEL)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_ACCEL);
   const uint8_t dReadyMask = 0b00001000;
   uint8_t statusRegVal = xmReadByte(STATUS_REG_A);
   if ((dReadyMask & statusRegVal) != 0)
@@ -441,6 +725,8 @@ bool LSM9DS0::newXData()
 
 bool LSM9DS0::newMData()
 {
+	if (!(initialized & INIT_MAG)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_MAG);
   const uint8_t dReadyMask = 0b00001000;
   uint8_t statusRegVal = xmReadByte(STATUS_REG_M);
   if ((dReadyMask & statusRegVal) != 0)
@@ -452,6 +738,8 @@ bool LSM9DS0::newMData()
 
 bool LSM9DS0::newGData()
 {
+	if (!(initialized & INIT_GYRO)) // Turn the sensor on if begin() didn't
+		initSensors(INIT_GYRO);
   const uint8_t dReadyMask = 0b00001000;
   uint8_t statusRegVal = gReadByte(STATUS_REG_G);
   if ((dReadyMask & statusRegVal) != 0)
@@ -494,6 +782,62 @@ bool LSM9DS0::mDataOverflow()
   return false;
 }
 
+void LSM9DS0::gWriteCtrl(uint8_t subAddress, uint8_t data)
+{
+  if (!gCtrlValid)
+    gReadCtrl(subAddress); // Read back the rest of the shadow copies first
+  gCtrl[subAddress - CTRL_REG1_G] = data;
+  if (!holdCtrlWrites)
+    gWriteByte(subAddress, data);
+}
+
+void LSM9DS0::xmWriteCtrl(uint8_t subAddress, uint8_t data)
+{
+  if (!xmCtrlValid)
+    xmReadCtrl(subAddress); // Read back the rest of the shadow copies first
+  xmCtrl[subAddress - CTRL_REG0_XM] = data;
+  if (!holdCtrlWrites)
+    xmWriteByte(subAddress, data);
+}
+
+uint8_t LSM9DS0::gReadCtrl(uint8_t subAddress)
+{
+  if (!gCtrlValid)
+  {
+    gReadBytes(CTRL_REG1_G, gCtrl, 5); // All of them in one burst
+    gCtrlValid = true;
+  }
+  return gCtrl[subAddress - CTRL_REG1_G];
+}
+
+uint8_t LSM9DS0::xmReadCtrl(uint8_t subAddress)
+{
+  if (!xmCtrlValid)
+  {
+    xmReadBytes(CTRL_REG0_XM, xmCtrl, 8); // All of them in one burst
+    xmCtrlValid = true;
+  }
+  return xmCtrl[subAddress - CTRL_REG0_XM];
+}
+
+void LSM9DS0::gWriteBytes(uint8_t subAddress, uint8_t* src, uint8_t count)
+{
+  uint8_t temp[9]; // Register address, then up to eight bytes
+  temp[0] = subAddress | 0x80; // Auto-increment
+  for (int i = 0; i < count; i++)
+    temp[i + 1] = src[i];
+  gyro->write(temp, count + 1);
+}
+
+void LSM9DS0::xmWriteBytes(uint8_t subAddress, uint8_t* src, uint8_t count)
+{
+  uint8_t temp[9]; // Register address, then up to eight bytes
+  temp[0] = subAddress | 0x80; // Auto-increment
+  for (int i = 0; i < count; i++)
+    temp[i + 1] = src[i];
+  xm->write(temp, count + 1);
+}
+
 void LSM9DS0::gWriteByte(uint8_t subAddress, uint8_t data)
 {
   gyro->writeReg(subAddress, data);
@@ -0,0 +1,121 @@
+/*
+ * action.cpp
+ *
+ * Actions run on movement without interrupting sampling
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <vector>
+
+#include "action.h"
+
+extern char **environ;
+
+/*
+ * The rules whose commands the SIGCHLD handler reaps
+ */
+static struct action_rule *action_rules;
+static int action_rule_count;
+
+/*
+ * Reap every finished child and clear its rule's pid
+ */
+static void action_reap(int sig);
+
+void action_init(struct action_rule *rules, int n) {
+	action_rules = rules;
+	action_rule_count = n;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = action_reap;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+}
+
+int action_update(struct action_rule *rules, int n, float deviation, int64_t now_ns) {
+	int ready = -1;
+	for(int i = 0; i < n; i++) {
+		struct action_rule *r = rules + i;
+		if(deviation < r->min) {
+			r->matched = 0;
+			continue;
+		}
+		if(++r->matched >= r->debounce && ready < 0)
+			ready = i; // rules are most severe first
+	}
+	if(ready < 0)
+		return -1;
+
+	struct action_rule *r = rules + ready;
+	if(now_ns < r->quiet_until_ns)
+		return -1;
+	if(__atomic_load_n(&r->pid, __ATOMIC_ACQUIRE)) { // don't pile up copies of a slow command
+		r->busy++;
+		return -1;
+	}
+	for(int i = ready; i < n; i++) { // this event is handled
+		int64_t quiet = now_ns + rules[i].cooldown_ms * 1000000LL;
+		if(quiet > rules[i].quiet_until_ns)
+			rules[i].quiet_until_ns = quiet;
+		rules[i].matched = 0;
+	}
+	if(!action_spawn(r, deviation))
+		return -1;
+	return ready;
+}
+
+bool action_spawn(struct action_rule *r, float deviation) {
+	char deviation_env[32];
+	snprintf(deviation_env, sizeof(deviation_env), "STILL_DEVIATION=%g", deviation);
+	std::vector<char *> env;
+	for(char **e = environ; *e; e++)
+		if(strncmp(*e, "STILL_DEVIATION=", 16))
+			env.push_back(*e);
+	env.push_back(deviation_env);
+	env.push_back(NULL);
+
+	// block SIGCHLD so the handler can't reap the child before its pid is
+	// stored; still's other threads (its own and mraa's interrupt thread)
+	// are started with it blocked for good, so it can only be handled here,
+	// once it's unblocked again
+	sigset_t chld, old;
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	pthread_sigmask(SIG_BLOCK, &chld, &old);
+	posix_spawnattr_t attr; // but the command starts with still's original mask
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &old);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+	pid_t pid;
+	int err = posix_spawn(&pid, r->path, NULL, &attr, r->argv, &env[0]);
+	posix_spawnattr_destroy(&attr);
+	if(!err) {
+		__atomic_store_n(&r->pid, pid, __ATOMIC_RELEASE);
+		r->fired++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if(err) {
+		fprintf(stderr, "unable to run %s: %s\n", r->path, strerror(err));
+		return false;
+	}
+	return true;
+}
+
+static void action_reap(int sig) { // SIGCHLD handler
+	int saved_errno = errno;
+	pid_t pid;
+	while((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+		for(int i = 0; i < action_rule_count; i++)
+			if(__atomic_load_n(&action_rules[i].pid, __ATOMIC_ACQUIRE) == pid)
+				__atomic_store_n(&action_rules[i].pid, 0, __ATOMIC_RELEASE);
+	errno = saved_errno;
+}
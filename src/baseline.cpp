@@ -0,0 +1,103 @@
+/*
+ * baseline.cpp
+ *
+ * Tracking of a device's calibrated mean as it drifts
+ */
+
+#include "baseline.h"
+
+/*
+ * Spread (variance, in degrees C squared) the quiet readings need before
+ * their coefficient is trusted
+ */
+#define BASELINE_MIN_VARIANCE 0.25
+
+Baseline::Baseline(const struct xyz *mean, float odr_hz, float tau_s, float quiet,
+		float confirm_s) :
+		alpha(1 / (tau_s * odr_hz)), quiet(quiet),
+		confirm((uint32_t) (confirm_s * odr_hz)), quiet_run(0),
+		base(*mean), have_temperature(false), first_celsius(0), celsius(0),
+		tracked_samples(0), interval_x(0), interval_y(0), interval_z(0),
+		interval_n(0), interval_quiet(true),
+		n(0), st(0), stt(0), sx(0), sy(0), sz(0), stx(0), sty(0), stz(0) {
+	coeff.x = coeff.y = coeff.z = 0;
+}
+
+void Baseline::update(const struct xyz *p, float deviation) { // O(1)
+	if(deviation >= quiet) { // maybe moving: stop until it's confirmed quiet again
+		quiet_run = 0;
+		interval_quiet = false;
+		return;
+	}
+	if(quiet_run < confirm) {
+		quiet_run++;
+		interval_quiet = false;
+		return;
+	}
+
+	// follow the sample, as it would have read at the first temperature
+	float dt = celsius - first_celsius;
+	base.x += alpha * (p->x - coeff.x * dt - base.x);
+	base.y += alpha * (p->y - coeff.y * dt - base.y);
+	base.z += alpha * (p->z - coeff.z * dt - base.z);
+	tracked_samples++;
+
+	interval_x += p->x;
+	interval_y += p->y;
+	interval_z += p->z;
+	interval_n++;
+}
+
+void Baseline::temperature(float celsius) { // fit the quiet interval, if it was
+	if(!have_temperature) {
+		first_celsius = celsius;
+		have_temperature = true;
+	}
+	float old_dt = this->celsius - first_celsius;
+	this->celsius = celsius;
+
+	if(interval_quiet && interval_n > 0) {
+		double t = celsius - first_celsius;
+		double x = interval_x / interval_n, y = interval_y / interval_n,
+				z = interval_z / interval_n;
+		n++;
+		st += t;
+		stt += t * t;
+		sx += x;
+		sy += y;
+		sz += z;
+		stx += t * x;
+		sty += t * y;
+		stz += t * z;
+
+		double variance = stt / n - (st / n) * (st / n);
+		if(variance >= BASELINE_MIN_VARIANCE) {
+			struct xyz old = coeff;
+			coeff.x = (stx / n - st / n * sx / n) / variance;
+			coeff.y = (sty / n - st / n * sy / n) / variance;
+			coeff.z = (stz / n - st / n * sz / n) / variance;
+			// keep the reference where it was at the last reading
+			base.x += (old.x - coeff.x) * old_dt;
+			base.y += (old.y - coeff.y) * old_dt;
+			base.z += (old.z - coeff.z) * old_dt;
+		}
+	}
+	interval_x = interval_y = interval_z = 0;
+	interval_n = 0;
+	interval_quiet = true;
+}
+
+void Baseline::reference(struct xyz *mean) { // along the model to this temperature
+	float dt = celsius - first_celsius;
+	mean->x = base.x + coeff.x * dt;
+	mean->y = base.y + coeff.y * dt;
+	mean->z = base.z + coeff.z * dt;
+}
+
+const struct xyz *Baseline::coefficient() {
+	return &coeff;
+}
+
+uint64_t Baseline::tracked() {
+	return tracked_samples;
+}
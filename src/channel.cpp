@@ -0,0 +1,75 @@
+/*
+ * channel.cpp
+ *
+ * A detection channel for a sensor other than the accelerometer
+ */
+
+#include <stdlib.h>
+
+#include "channel.h"
+
+Channel::Channel(Detector *detector, int n, float threshold, bool relative,
+		int64_t period_ns) :
+		detector(detector), n(n), threshold(threshold), relative(relative),
+		period(period_ns), next(0), pos(0), samples(0), limit(0),
+		has_moved(false) {
+	window = (struct xyz *) malloc(n * sizeof(struct xyz));
+}
+
+Channel::~Channel() {
+	free(window);
+	delete detector;
+}
+
+int64_t Channel::due() {
+	return next;
+}
+
+void Channel::notReady(int64_t now_ns) {
+	next = now_ns + period / 8; // it's due any moment
+}
+
+void Channel::skip(int64_t now_ns) {
+	// check a little early so the loop's wakeups don't push the schedule later
+	next = now_ns + period - period / 8;
+}
+
+bool Channel::update(const struct xyz *p, int64_t now_ns) {
+	skip(now_ns);
+
+	struct xyz *slot = window + pos;
+	struct xyz evicted = *slot; // the sample leaving the detector's window
+	*slot = *p;
+	pos = (pos + 1) % n;
+
+	if(samples < n) { // still collecting calibration samples
+		if(++samples == n) {
+			xyz_mean(&mean, window, n);
+			// renormalize the window from the calibrated mean
+			for(int i = 0; i < n; i++)
+				xyz_subtract(window + i, &mean);
+			limit = relative ? threshold * xyz_magnitude(&mean) : threshold;
+			detector->calibrate(window, n, limit);
+		}
+		return false;
+	}
+
+	xyz_subtract(slot, &mean);
+	has_moved = detector->update(slot, &evicted);
+	return has_moved;
+}
+
+bool Channel::calibrated() {
+	return samples == n;
+}
+
+bool Channel::moved() {
+	return has_moved;
+}
+
+float Channel::ratio() {
+	if(!calibrated() || limit <= 0)
+		return 0;
+	float r = detector->magnitude() / limit;
+	return has_moved && r < 1 ? 1 : r; // e.g. welford's spread
+}
@@ -0,0 +1,567 @@
+/*
+ * detector.cpp
+ *
+ * Movement detectors
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "detector.h"
+
+const char *detector_names = "boxcar, sum, welford, ewma, int, band";
+
+/*
+ * Mean of the window, rescanned every sample.  O(n) per sample, but
+ * it's the reference the others are measured against.
+ */
+class BoxcarDetector : public Detector {
+public:
+	void calibrate(const struct xyz *window, int n, float limit) {
+		this->window = window;
+		this->n = n;
+		this->limit = limit;
+		current = 0;
+	}
+
+	bool update(const struct xyz *p, const struct xyz *evicted) {
+		struct xyz mean;
+		xyz_mean(&mean, window, n);
+		current = xyz_magnitude(&mean);
+		return current > limit;
+	}
+
+	float magnitude() {
+		return current;
+	}
+
+private:
+	const struct xyz *window;
+	int n;
+	float limit;
+	float current;
+};
+
+/*
+ * Mean of the window from running sums: add the new sample, subtract the
+ * evicted one.  The sums are recomputed from the window once per window
+ * length so rounding error can't accumulate.  Blocks slide through the sums
+ * with xyz_block_window_means(), and the means' magnitudes come out of one
+ * kernel.
+ */
+class SumDetector : public Detector {
+public:
+	void calibrate(const struct xyz *window, int n, float limit) {
+		this->window = window;
+		this->n = n;
+		this->limit = limit;
+		current = 0;
+		pending = NULL;
+		resync();
+	}
+
+	bool update(const struct xyz *p, const struct xyz *evicted) {
+		if(++updates >= n) // drift-free: start over from the window
+			resync();
+		else {
+			sx += (double) p->x - evicted->x;
+			sy += (double) p->y - evicted->y;
+			sz += (double) p->z - evicted->z;
+		}
+		struct xyz mean = { (float) (sx / n), (float) (sy / n), (float) (sz / n) };
+		current = xyz_magnitude(&mean);
+		return current > limit;
+	}
+
+	bool update_block(const struct xyz_block *p, int first, int k, bool *moved,
+			float *magnitudes) {
+		struct xyz_block evicted = {}, means = {};
+		xyz_block_load(&evicted, window, n, first, k);
+		double sums[3] = { sx, sy, sz };
+		for(int j = 0; j < k;) {
+			int slide = std::min(k - j, n - 1 - updates); // samples before the next resync()
+			if(slide > 0) {
+				xyz_block_window_means(&means, p, &evicted, j, j + slide, n, sums);
+				updates += slide;
+				j += slide;
+				continue;
+			}
+			begin_pending(p, first, j + 1);
+			resync();
+			end_pending();
+			sums[0] = sx;
+			sums[1] = sy;
+			sums[2] = sz;
+			means.x[j] = (float) (sx / n);
+			means.y[j] = (float) (sy / n);
+			means.z[j] = (float) (sz / n);
+			j++;
+		}
+		sx = sums[0];
+		sy = sums[1];
+		sz = sums[2];
+
+		xyz_block_magnitudes(&means, k, magnitudes);
+		for(int j = 0; j < k; j++)
+			moved[j] = magnitudes[j] > limit;
+		current = magnitudes[k - 1];
+		return true;
+	}
+
+	float magnitude() {
+		return current;
+	}
+
+protected:
+	const struct xyz *window;
+	int n;
+	float limit;
+	float current;
+	// running sums of the window
+	double sx, sy, sz;
+	// updates since the last resync()
+	int updates;
+	// during update_block(), the block and how many of its samples, from
+	// slot pending_first on, are in the window as far as resync() is concerned
+	const struct xyz_block *pending;
+	int pending_first, pending_count;
+
+	virtual void resync() {
+		sx = sy = sz = 0;
+		for(int i = 0; i < n; i++) {
+			struct xyz p = at(i);
+			sx += p.x;
+			sy += p.y;
+			sz += p.z;
+		}
+		updates = 0;
+	}
+
+	/*
+	 * Return slot i of the window as of the sample being updated
+	 */
+	struct xyz at(int i) {
+		if(pending) {
+			int age = i - pending_first;
+			if(age < 0)
+				age += n;
+			if(age < pending_count) {
+				struct xyz p = { pending->x[age], pending->y[age], pending->z[age] };
+				return p;
+			}
+		}
+		return window[i];
+	}
+
+	void begin_pending(const struct xyz_block *p, int first, int count) {
+		pending = p;
+		pending_first = first;
+		pending_count = count;
+	}
+
+	void end_pending() {
+		pending = NULL;
+	}
+};
+
+/*
+ * Running mean as with SumDetector, plus Welford's running variance of the
+ * window.  Also triggers if the spread of the window (the root of the summed
+ * per-axis variances) grows past its calibrated value by more than limit,
+ * catching vibration that averages out of the mean.
+ */
+class WelfordDetector : public SumDetector {
+public:
+	void calibrate(const struct xyz *window, int n, float limit) {
+		SumDetector::calibrate(window, n, limit);
+		calibrated_spread = spread();
+	}
+
+	bool update(const struct xyz *p, const struct xyz *evicted) {
+		if(updates + 1 < n) { // otherwise SumDetector is about to resync()
+			// sliding window Welford step for each axis, before the sums move
+			step(&m2x, sx, p->x, evicted->x);
+			step(&m2y, sy, p->y, evicted->y);
+			step(&m2z, sz, p->z, evicted->z);
+		}
+		bool moved = SumDetector::update(p, evicted);
+		return moved || spread() - calibrated_spread > limit;
+	}
+
+	bool update_block(const struct xyz_block *p, int first, int k, bool *moved,
+			float *magnitudes) { // the variance steps are sequential, so one at a time
+		struct xyz_block evicted = {};
+		xyz_block_load(&evicted, window, n, first, k);
+		for(int j = 0; j < k; j++) {
+			struct xyz q = { p->x[j], p->y[j], p->z[j] };
+			struct xyz e = { evicted.x[j], evicted.y[j], evicted.z[j] };
+			begin_pending(p, first, j + 1);
+			moved[j] = update(&q, &e);
+			end_pending();
+			magnitudes[j] = current;
+		}
+		return true;
+	}
+
+private:
+	// running sums of squared deviations from the window mean
+	double m2x, m2y, m2z;
+	// spread() at calibration
+	float calibrated_spread;
+
+	void resync() {
+		SumDetector::resync();
+		double mx = sx / n, my = sy / n, mz = sz / n;
+		m2x = m2y = m2z = 0;
+		for(int i = 0; i < n; i++) {
+			struct xyz p = at(i);
+			m2x += (p.x - mx) * (p.x - mx);
+			m2y += (p.y - my) * (p.y - my);
+			m2z += (p.z - mz) * (p.z - mz);
+		}
+	}
+
+	void step(double *m2, double sum, float in, float out) {
+		double mean = sum / n;
+		double next = (sum + in - out) / n;
+		*m2 += ((double) in - out) * (in - next + out - mean);
+	}
+
+	float spread() {
+		double v = (m2x + m2y + m2z) / n;
+		return v > 0 ? sqrt(v) : 0;
+	}
+};
+
+/*
+ * Exponentially weighted moving average, with the same span (alpha = 2/(n+1))
+ * as an n-sample window.  Doesn't look at the window at all after calibration.
+ */
+class EwmaDetector : public Detector {
+public:
+	void calibrate(const struct xyz *window, int n, float limit) {
+		this->limit = limit;
+		alpha = 2.0 / (n + 1);
+		xyz_mean(&average, window, n);
+		current = xyz_magnitude(&average);
+	}
+
+	bool update(const struct xyz *p, const struct xyz *evicted) {
+		average.x += alpha * (p->x - average.x);
+		average.y += alpha * (p->y - average.y);
+		average.z += alpha * (p->z - average.z);
+		current = xyz_magnitude(&average);
+		return current > limit;
+	}
+
+	bool update_block(const struct xyz_block *p, int first, int k, bool *moved,
+			float *magnitudes) {
+		struct xyz_block averages = {};
+		for(int j = 0; j < k; j++) { // the average is a recurrence, only the magnitudes vectorize
+			averages.x[j] = average.x += alpha * (p->x[j] - average.x);
+			averages.y[j] = average.y += alpha * (p->y[j] - average.y);
+			averages.z[j] = average.z += alpha * (p->z[j] - average.z);
+		}
+		xyz_block_magnitudes(&averages, k, magnitudes);
+		for(int j = 0; j < k; j++)
+			moved[j] = magnitudes[j] > limit;
+		current = magnitudes[k - 1];
+		return true;
+	}
+
+	float magnitude() {
+		return current;
+	}
+
+private:
+	float limit;
+	float alpha;
+	struct xyz average;
+	float current;
+};
+
+/*
+ * The sum detector on raw ticks.  With S the window sum and C the calibrated
+ * sum, the float detectors trigger when |S/n - C/n| * res > threshold * |C/n| * res.
+ * The resolution and n cancel, leaving |S - C|^2 > threshold^2 * |C|^2, which
+ * is exact in 64-bit integers for any accelerometer scale.  The sums are exact
+ * too, so they never need resyncing.
+ */
+class IntDetector : public RawDetector {
+public:
+	void calibrate(const struct xyz_raw *window, int n, float threshold,
+			struct xyz *mean) {
+		this->n = n;
+		this->threshold = threshold;
+		sx = sy = sz = 0;
+		for(int i = 0; i < n; i++) {
+			sx += window[i].x;
+			sy += window[i].y;
+			sz += window[i].z;
+		}
+		cx = sx;
+		cy = sy;
+		cz = sz;
+		mean->x = (float) cx / n;
+		mean->y = (float) cy / n;
+		mean->z = (float) cz / n;
+		limits();
+	}
+
+	bool update(const struct xyz_raw *p, const struct xyz_raw *evicted) {
+		sx += p->x - evicted->x;
+		sy += p->y - evicted->y;
+		sz += p->z - evicted->z;
+		int64_t dx = sx - cx, dy = sy - cy, dz = sz - cz;
+		return dx*dx + dy*dy + dz*dz > limit2;
+	}
+
+	void recenter(const struct xyz *mean) { // the nearest sums
+		cx = lroundf(mean->x * n);
+		cy = lroundf(mean->y * n);
+		cz = lroundf(mean->z * n);
+		limits();
+	}
+
+	float deviation() { // only here is there a sqrt
+		int64_t dx = sx - cx, dy = sy - cy, dz = sz - cz;
+		return c2 > 0 ? sqrt((dx*dx + dy*dy + dz*dz) / c2) : 0;
+	}
+
+private:
+	int n;
+	float threshold;
+	// running and calibrated sums of the window
+	int32_t sx, sy, sz;
+	int32_t cx, cy, cz;
+	// squared magnitude of the calibrated sums, and squared trigger distance
+	double c2;
+	int64_t limit2;
+
+	void limits() { // float math only when the calibrated sums change
+		// anything at or below the floor is no trigger
+		c2 = (double) cx*cx + (double) cy*cy + (double) cz*cz;
+		limit2 = (int64_t) floor((double) threshold * threshold * c2);
+	}
+};
+
+/*
+ * Four floats handled as one, x, y, z and padding.  GCC turns the arithmetic
+ * into SSE where the target has it and into plain floats otherwise.
+ */
+typedef float v4sf __attribute__((vector_size(16)));
+
+/*
+ * Write the first and last DFT bins of band *b with a window of n samples at
+ * odr_hz to *first and *last, leaving out the mean and anything past Nyquist
+ */
+static void band_range(const struct band *b, int n, float odr_hz, int *first, int *last);
+
+/*
+ * Energy in bands of frequencies from a sliding DFT of the newest m samples
+ * of the window.  Every watched bin k is updated in O(1) per sample as
+ * X = w^k (X - evicted + new), w = e^(2 pi i / m), with all three axes side
+ * by side in a vector, and recomputed from the window once every m samples
+ * so rounding error in the rotations can't accumulate.  m is the whole window
+ * unless the bands would need more than BAND_DETECTOR_MAX_BINS bins, in which
+ * case it's shortened until they fit, coarsening the bins.
+ */
+class BandDetector : public Detector {
+public:
+	BandDetector(const struct band *bands, int n_bands, float odr_hz) :
+			n_bands(n_bands), odr_hz(odr_hz), window(NULL), n(0), m(0), n_bins(0),
+			cosines(NULL), sines(NULL) {
+		this->bands = (struct band *) malloc(n_bands * sizeof(struct band));
+		memcpy(this->bands, bands, n_bands * sizeof(struct band));
+		calibrated = (float *) calloc(n_bands, sizeof(float));
+		band_end = (int *) calloc(n_bands, sizeof(int));
+	}
+
+	~BandDetector() {
+		free(bands);
+		free(calibrated);
+		free(band_end);
+		free(cosines);
+		free(sines);
+	}
+
+	void calibrate(const struct xyz *window, int n, float limit) {
+		this->window = window;
+		this->n = n;
+		this->limit = limit;
+		current = 0;
+
+		for(m = n; m > 1 && bins(m) > BAND_DETECTOR_MAX_BINS; m--)
+			;
+		n_bins = 0;
+		for(int b = 0; b < n_bands; b++) {
+			int first, last;
+			watched_range(bands + b, &first, &last);
+			for(int k = first; k <= last && n_bins < BAND_DETECTOR_MAX_BINS; k++) {
+				bin_k[n_bins] = k;
+				rotate_cos[n_bins] = cos(2 * M_PI * k / m);
+				rotate_sin[n_bins] = sin(2 * M_PI * k / m);
+				n_bins++;
+			}
+			band_end[b] = n_bins;
+		}
+
+		free(cosines); // e^(-2 pi i j / m) for every j, for resync()
+		free(sines);
+		cosines = (float *) malloc(m * sizeof(float));
+		sines = (float *) malloc(m * sizeof(float));
+		for(int j = 0; j < m; j++) {
+			cosines[j] = cos(2 * M_PI * j / m);
+			sines[j] = -sin(2 * M_PI * j / m);
+		}
+
+		// which sample is newest isn't known until update(), so calibrate there
+		updates = m - 1;
+		have_calibrated = false;
+	}
+
+	bool update(const struct xyz *p, const struct xyz *evicted) {
+		int newest = p - window;
+		if(++updates >= m) // drift-free: start over from the newest m samples
+			resync((newest - m + 1 + n) % n);
+		else {
+			if(m < n) // the sample leaving the DFT is still in the window
+				evicted = window + (newest - m + n) % n;
+			v4sf d = { p->x - evicted->x, p->y - evicted->y, p->z - evicted->z, 0 };
+			for(int i = 0; i < n_bins; i++) {
+				v4sf r = re[i] + d;
+				v4sf c = { rotate_cos[i], rotate_cos[i], rotate_cos[i], 0 };
+				v4sf s = { rotate_sin[i], rotate_sin[i], rotate_sin[i], 0 };
+				re[i] = r * c - im[i] * s;
+				im[i] = r * s + im[i] * c;
+			}
+		}
+
+		if(!have_calibrated) { // the calibration's energy is the floor
+			for(int b = 0; b < n_bands; b++)
+				calibrated[b] = amplitude(b);
+			have_calibrated = true;
+		}
+		current = 0;
+		for(int b = 0; b < n_bands; b++) {
+			float grown = amplitude(b) - calibrated[b];
+			if(grown > current)
+				current = grown;
+		}
+		return current > limit;
+	}
+
+	float magnitude() {
+		return current;
+	}
+
+private:
+	struct band *bands;
+	int n_bands;
+	float odr_hz;
+	const struct xyz *window;
+	int n;
+	int m;	// length of the DFT
+	float limit;
+	float current;
+	// amplitude of each band at calibration
+	float *calibrated;
+	bool have_calibrated;
+	// updates since the last resync()
+	int updates;
+
+	// the watched bins: k, the rotation by w^k, and X_k for each axis
+	int n_bins;
+	int bin_k[BAND_DETECTOR_MAX_BINS];
+	float rotate_cos[BAND_DETECTOR_MAX_BINS], rotate_sin[BAND_DETECTOR_MAX_BINS];
+	v4sf re[BAND_DETECTOR_MAX_BINS], im[BAND_DETECTOR_MAX_BINS];
+	// band b's bins end at band_end[b] and start at the previous band's end
+	int *band_end;
+	// the DFT's twiddles, by (k * j) % m
+	float *cosines, *sines;
+
+	void watched_range(const struct band *b, int *first, int *last) { // at length m
+		band_range(b, m, odr_hz, first, last);
+		if(*first > *last) { // too narrow for these bins: the nearest one
+			*first = *last = (int) floor((b->low_hz + b->high_hz) / 2 * m / odr_hz + 0.5);
+			if(*first < 1)
+				*first = *last = 1;
+			if(*first > m / 2)
+				*first = *last = m / 2;
+		}
+	}
+
+	int bins(int m) { // every band's bins at length m
+		this->m = m;
+		int total = 0;
+		for(int b = 0; b < n_bands; b++) {
+			int first, last;
+			watched_range(bands + b, &first, &last);
+			total += last - first + 1;
+		}
+		return total;
+	}
+
+	void resync(int start) { // the DFT of m samples from start, O(m) per bin
+		for(int i = 0; i < n_bins; i++) {
+			v4sf r = { 0, 0, 0, 0 }, s = { 0, 0, 0, 0 };
+			for(int j = 0, t = 0; j < m; j++, t = (t + bin_k[i]) % m) {
+				const struct xyz *q = window + (start + j) % n;
+				v4sf x = { q->x, q->y, q->z, 0 };
+				v4sf c = { cosines[t], cosines[t], cosines[t], 0 };
+				v4sf z = { sines[t], sines[t], sines[t], 0 };
+				r += x * c;
+				s += x * z;
+			}
+			re[i] = r;
+			im[i] = s;
+		}
+		updates = 0;
+	}
+
+	float amplitude(int b) { // of a sine with band b's energy, in g
+		v4sf e = { 0, 0, 0, 0 };
+		for(int i = b ? band_end[b - 1] : 0; i < band_end[b]; i++)
+			e += re[i] * re[i] + im[i] * im[i];
+		return 2 * sqrt(e[0] + e[1] + e[2]) / m;
+	}
+};
+
+Detector *make_detector(const std::string &name) {
+	if(name == "boxcar")
+		return new BoxcarDetector();
+	if(name == "sum")
+		return new SumDetector();
+	if(name == "welford")
+		return new WelfordDetector();
+	if(name == "ewma")
+		return new EwmaDetector();
+	return NULL;
+}
+
+RawDetector *make_raw_detector(const std::string &name) {
+	if(name == "int")
+		return new IntDetector();
+	return NULL;
+}
+
+Detector *make_band_detector(const struct band *bands, int n, float odr_hz) {
+	return new BandDetector(bands, n, odr_hz);
+}
+
+int band_bins(const struct band *b, int n, float odr_hz) {
+	int first, last;
+	band_range(b, n, odr_hz, &first, &last);
+	return last >= first ? last - first + 1 : 0;
+}
+
+static void band_range(const struct band *b, int n, float odr_hz, int *first, int *last) {
+	*first = (int) ceil(b->low_hz * n / odr_hz);
+	if(*first < 1) // never the mean
+		*first = 1;
+	*last = (int) floor(b->high_hz * n / odr_hz);
+	if(*last > n / 2) // nor past Nyquist
+		*last = n / 2;
+}
@@ -0,0 +1,109 @@
+/*
+ * histogram.cpp
+ *
+ * Log-bucketed histograms of durations in nanoseconds
+ */
+
+#include <inttypes.h>
+
+#include "histogram.h"
+
+/*
+ * Return the bucket holding v
+ */
+static int bucket_of(uint64_t v);
+/*
+ * Return the lowest value in bucket i
+ */
+static uint64_t bucket_lowest(int i);
+/*
+ * Read *p atomically, even where 64-bit loads aren't
+ */
+static uint64_t load(uint64_t *p);
+
+void histogram_record(struct histogram *h, int64_t ns) {
+	if(ns < 0)
+		ns = 0;
+	__sync_fetch_and_add(&h->buckets[bucket_of(ns)], 1);
+	__sync_fetch_and_add(&h->sum, ns);
+	// min is stored plus one, so zero-initialized means unset
+	int64_t old;
+	while(((old = h->min) == 0 || ns + 1 < old) &&
+			!__sync_bool_compare_and_swap(&h->min, old, ns + 1))
+		;
+	while(ns > (old = h->max) &&
+			!__sync_bool_compare_and_swap(&h->max, old, ns))
+		;
+	// count last, so a reader never sees more samples than buckets hold
+	__sync_fetch_and_add(&h->count, 1);
+}
+
+int64_t histogram_percentile(struct histogram *h, double p) {
+	uint64_t count = load(&h->count);
+	if(count == 0)
+		return 0;
+	uint64_t rank = (uint64_t) (p * count + 0.5);
+	if(rank < 1)
+		rank = 1;
+	if(rank > count)
+		rank = count;
+	int64_t min = (int64_t) load((uint64_t *) &h->min) - 1;
+	int64_t max = (int64_t) load((uint64_t *) &h->max);
+	uint64_t seen = 0;
+	for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += load(&h->buckets[i]);
+		if(seen >= rank) {
+			uint64_t highest = bucket_lowest(i + 1) - 1;
+			if(highest < (uint64_t) min)
+				return min;
+			return highest > (uint64_t) max ? max : (int64_t) highest;
+		}
+	}
+	return max;
+}
+
+void histogram_reset(struct histogram *h) {
+	for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		__sync_lock_test_and_set(&h->buckets[i], 0);
+	__sync_lock_test_and_set(&h->count, 0);
+	__sync_lock_test_and_set(&h->sum, 0);
+	__sync_lock_test_and_set(&h->min, 0);
+	__sync_lock_test_and_set(&h->max, 0);
+}
+
+void histogram_print(FILE *f, const char *name, struct histogram *h) {
+	uint64_t count = load(&h->count);
+	int64_t sum = (int64_t) load((uint64_t *) &h->sum);
+	fprintf(f, "%s count=%" PRIu64 " min=%" PRId64 " mean=%" PRId64
+			" p50=%" PRId64 " p90=%" PRId64 " p99=%" PRId64 " p999=%" PRId64
+			" max=%" PRId64 "\n",
+			name, count, count ? (int64_t) load((uint64_t *) &h->min) - 1 : 0,
+			count ? sum / (int64_t) count : 0,
+			histogram_percentile(h, 0.5), histogram_percentile(h, 0.9),
+			histogram_percentile(h, 0.99), histogram_percentile(h, 0.999),
+			(int64_t) load((uint64_t *) &h->max));
+	for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		uint64_t n = load(&h->buckets[i]);
+		if(n)
+			fprintf(f, "\t%" PRIu64 " %" PRIu64 "\n", bucket_lowest(i), n);
+	}
+}
+
+static int bucket_of(uint64_t v) {
+	if(v < HISTOGRAM_SUB_BUCKETS) // exact below the first full power of two
+		return v;
+	int e = 63 - __builtin_clzll(v); // v's highest bit, at least HISTOGRAM_SUB_BITS
+	return (e - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+			((v >> (e - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static uint64_t bucket_lowest(int i) {
+	if(i < HISTOGRAM_SUB_BUCKETS)
+		return i;
+	int e = i / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+	return (uint64_t) (HISTOGRAM_SUB_BUCKETS + i % HISTOGRAM_SUB_BUCKETS) << (e - HISTOGRAM_SUB_BITS);
+}
+
+static uint64_t load(uint64_t *p) {
+	return __sync_fetch_and_add(p, 0);
+}
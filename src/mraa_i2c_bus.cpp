@@ -0,0 +1,40 @@
+/*
+ * mraa_i2c_bus.cpp
+ *
+ * I2cBus through mraa
+ */
+
+#include "mraa_i2c_bus.h"
+
+MraaI2cBus::MraaI2cBus(int bus, uint8_t address) : i2c(bus) {
+	i2c.address(address);
+}
+
+uint8_t MraaI2cBus::readReg(uint8_t reg) {
+	return i2c.readReg(reg);
+}
+
+int MraaI2cBus::readBytesReg(uint8_t reg, uint8_t *data, int length) {
+	return i2c.readBytesReg(reg, data, length);
+}
+
+void MraaI2cBus::writeReg(uint8_t reg, uint8_t data) {
+	i2c.writeReg(reg, data);
+}
+
+void MraaI2cBus::write(const uint8_t *data, int length) {
+	i2c.write(data, length);
+}
+
+bool MraaI2cBus::setSpeed(int hz) {
+	mraa::I2cMode mode;
+	if (hz == 100000)
+		mode = mraa::I2C_STD;
+	else if (hz == 400000)
+		mode = mraa::I2C_FAST;
+	else if (hz == 3400000)
+		mode = mraa::I2C_HIGH;
+	else
+		return false;
+	return i2c.frequency(mode) == mraa::SUCCESS;
+}
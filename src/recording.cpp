@@ -0,0 +1,127 @@
+/*
+ * recording.cpp
+ *
+ * Raw accelerometer samples recorded to a fixed-size ring file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "recording.h"
+
+struct recorder *recorder_create(const char *path, uint32_t capacity,
+		const struct record_header *h) {
+	size_t size = sizeof(struct record_header) + (size_t) capacity * sizeof(struct record_sample);
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+		return NULL;
+	if(ftruncate(fd, size) < 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return NULL;
+	}
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	int e = errno;
+	close(fd); // the mapping keeps the file
+	if(map == MAP_FAILED) {
+		errno = e;
+		return NULL;
+	}
+
+	struct recorder *r = (struct recorder *) malloc(sizeof(struct recorder));
+	r->header = (struct record_header *) map;
+	r->ring = (struct record_sample *) (r->header + 1);
+	r->capacity = capacity;
+	r->written = 0;
+	r->size = size;
+	r->synced_ns = h->start_ns;
+
+	*r->header = *h;
+	memcpy(r->header->magic, RECORD_MAGIC, sizeof(r->header->magic));
+	r->header->version = RECORD_VERSION;
+	r->header->header_size = sizeof(struct record_header);
+	r->header->capacity = capacity;
+	r->header->written = 0;
+	return r;
+}
+
+void recorder_append(struct recorder *r, int device, int64_t t_ns,
+		const struct xyz_raw *p, uint8_t status) {
+	struct record_sample *s = r->ring + r->written % r->capacity;
+	s->t_ns = t_ns;
+	s->x = p->x;
+	s->y = p->y;
+	s->z = p->z;
+	s->status = status;
+	s->device = device;
+	r->header->written = ++r->written; // after the sample, for anyone reading along
+}
+
+void recorder_calibrated(struct recorder *r, int device, const struct xyz *mean) {
+	if(device >= RECORD_MAX_DEVICES)
+		return;
+	struct record_calibration *c = r->header->calibration + device;
+	c->x = mean->x;
+	c->y = mean->y;
+	c->z = mean->z;
+	c->calibrated = 1;
+}
+
+void recorder_sync(struct recorder *r, int64_t now_ns) {
+	if(now_ns - r->synced_ns < RECORD_SYNC_NS)
+		return;
+	msync(r->header, r->size, MS_ASYNC);
+	r->synced_ns = now_ns;
+}
+
+const struct record_header *record_open(const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return NULL;
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return NULL;
+	}
+	if((size_t) st.st_size < sizeof(struct record_header)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	int e = errno;
+	close(fd);
+	if(map == MAP_FAILED) {
+		errno = e;
+		return NULL;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL); // replays read it front to back, mostly
+
+	const struct record_header *h = (const struct record_header *) map;
+	if(memcmp(h->magic, RECORD_MAGIC, sizeof(h->magic)) || h->version != RECORD_VERSION ||
+			h->header_size != sizeof(struct record_header) || !h->capacity ||
+			(size_t) st.st_size < h->header_size +
+					(size_t) h->capacity * sizeof(struct record_sample)) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+	return h;
+}
+
+uint64_t record_samples(const struct record_header *h) {
+	return h->written < h->capacity ? h->written : h->capacity;
+}
+
+const struct record_sample *record_sample(const struct record_header *h, uint64_t i) {
+	const struct record_sample *ring = (const struct record_sample *) (h + 1);
+	return ring + (h->written - record_samples(h) + i) % h->capacity;
+}
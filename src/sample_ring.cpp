@@ -0,0 +1,67 @@
+/*
+ * sample_ring.cpp
+ *
+ * A wait-free SPSC ring of accelerometer sample batches
+ */
+
+#include <stdlib.h>
+
+#include "sample_ring.h"
+
+SampleRing::SampleRing(int capacity) : head(0), tail(0), overrun_count(0),
+		overrun_samples(0), high_water(0) {
+	uint32_t size = 1;
+	while(size < (uint32_t) capacity)
+		size <<= 1;
+	mask = size - 1;
+	batches = (struct sample_batch *) malloc(size * sizeof(struct sample_batch));
+}
+
+SampleRing::~SampleRing() {
+	free(batches);
+}
+
+// Each side loads the other's index with acquire and stores its own with
+// release, so a batch is copied in before tail passes it and copied out
+// before head does.  No locked instructions, no loops: wait-free.
+
+bool SampleRing::push(const struct sample_batch *b) {
+	uint32_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED); // only this thread writes it
+	uint32_t used = t - __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	if(used > mask) {
+		__sync_fetch_and_add(&overrun_count, 1);
+		__sync_fetch_and_add(&overrun_samples, b->n);
+		return false;
+	}
+	batches[t & mask] = *b;
+	__atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+	if(used + 1 > __atomic_load_n(&high_water, __ATOMIC_RELAXED))
+		__atomic_store_n(&high_water, used + 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+bool SampleRing::full() {
+	return __atomic_load_n(&tail, __ATOMIC_RELAXED) -
+			__atomic_load_n(&head, __ATOMIC_ACQUIRE) > mask;
+}
+
+bool SampleRing::pop(struct sample_batch *b) {
+	uint32_t h = __atomic_load_n(&head, __ATOMIC_RELAXED); // only this thread writes it
+	if(__atomic_load_n(&tail, __ATOMIC_ACQUIRE) == h)
+		return false;
+	*b = batches[h & mask];
+	__atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+uint64_t SampleRing::overruns() {
+	return __sync_fetch_and_add(&overrun_count, 0);
+}
+
+uint64_t SampleRing::overrunSamples() {
+	return __sync_fetch_and_add(&overrun_samples, 0);
+}
+
+uint32_t SampleRing::highWater() {
+	return __atomic_load_n(&high_water, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,578 @@
+/*
+ * sim_lsm9ds0.cpp
+ *
+ * A simulated LSM9DS0 on a virtual clock
+ */
+
+#include <math.h>
+
+#include "SFE_LSM9DS0.h"
+#include "sim_lsm9ds0.h"
+
+/*
+ * One of the two devices, as seen from the driver.  Each call is one
+ * transaction, and bit 7 of the register address auto-increments.
+ */
+class SimLSM9DS0::Bus : public I2cBus {
+public:
+	Bus(SimLSM9DS0 *sim, bool isGyro) : sim(sim), isGyro(isGyro) {}
+
+	uint8_t readReg(uint8_t reg) {
+		sim->transaction(1);
+		return sim->read(isGyro, reg & 0x7F);
+	}
+
+	int readBytesReg(uint8_t reg, uint8_t *data, int length) {
+		bool increment = reg & 0x80;
+		reg &= 0x7F;
+		// The FIFO pops a sample as its last byte is clocked out, making room
+		// while a long burst runs, so charge FIFO bursts a byte at a time
+		bool fifoBurst = !isGyro && reg == OUT_X_L_A && sim->fifoEnabled();
+		sim->transaction(fifoBurst ? 0 : length);
+		for (int i = 0; i < length; i++) {
+			if (fifoBurst)
+				sim->clockBytes(1);
+			data[i] = sim->read(isGyro, reg);
+			if (increment)
+				reg = sim->nextReg(isGyro, reg);
+		}
+		return length;
+	}
+
+	void writeReg(uint8_t reg, uint8_t data) {
+		sim->transaction(1);
+		sim->write(isGyro, reg & 0x7F, data);
+	}
+
+	void write(const uint8_t *data, int length) {
+		if (length < 1)
+			return;
+		sim->transaction(length - 1);
+		bool increment = data[0] & 0x80;
+		uint8_t reg = data[0] & 0x7F;
+		for (int i = 1; i < length; i++) {
+			sim->write(isGyro, reg, data[i]);
+			if (increment)
+				reg = sim->nextReg(isGyro, reg);
+		}
+	}
+
+	bool setSpeed(int hz) {
+		if (hz <= 0)
+			return false;
+		sim->setBusSpeed(hz);
+		return true;
+	}
+
+private:
+	SimLSM9DS0 *sim;
+	bool isGyro;
+};
+
+// Accelerometer ODRs by AODR, in Hz
+static const float accel_odr_hz[] = {
+	0, 3.125, 6.25, 12.5, 25, 50, 100, 200, 400, 800, 1600
+};
+// Gyroscope ODRs by DR, in Hz
+static const float gyro_odr_hz[] = { 95, 190, 380, 760 };
+// Magnetometer ODRs by M_ODR, in Hz
+static const float mag_odr_hz[] = { 3.125, 6.25, 12.5, 25, 50, 100 };
+
+// Full scales by AFS, GFS and MFS
+static const float accel_fs[] = { 2, 4, 6, 8, 16 };
+static const float gyro_fs[] = { 245, 500, 2000, 2000 };
+static const float mag_fs[] = { 2, 4, 8, 12 };
+
+/*
+ * Convert a reading to a 16-bit output for a full scale of fs
+ */
+static int16_t to_raw(float value, float fs);
+
+SimLSM9DS0::SimLSM9DS0(uint32_t seed, SimLSM9DS0 *busPeer) :
+		gyro(new Bus(this, true)), xm(new Bus(this, false)),
+		ownClock(0), clock(busPeer ? busPeer->clock : ownClock),
+		bus_hz(100000), transaction_count(0),
+		temp(25), tempRate(0), tempStart(0),
+		rng(0x9E3779B97F4A7C15ULL ^ seed),
+		gNext(-1), aNext(-1), mNext(-1),
+		aSamples(0), aLost(0),
+		aUnread(false), gUnread(false), mUnread(false),
+		aOverrun(false), gOverrun(false), mOverrun(false),
+		fifoHead(0), fifoCount(0), fifoOverrun(false),
+		hpfPrimed(false), spare(0), haveSpare(false) {
+	for (int i = 0; i < 0x40; i++)
+		gRegs[i] = xmRegs[i] = 0;
+	// Power-on defaults: everything powered down, magnetometer in
+	// single-conversion mode
+	gRegs[WHO_AM_I_G] = 0xD4;
+	gRegs[CTRL_REG1_G] = 0x07;
+	xmRegs[WHO_AM_I_XM] = 0x49;
+	xmRegs[CTRL_REG1_XM] = 0x07;
+	xmRegs[CTRL_REG5_XM] = 0x18;
+	xmRegs[CTRL_REG6_XM] = 0x20;
+	xmRegs[CTRL_REG7_XM] = 0x01;
+
+	noise[ACCEL] = 0.001;
+	noise[GYRO] = 0.1;
+	noise[MAG] = 0.002;
+	setBaseline(ACCEL, 0, 0, 1);
+	setBaseline(GYRO, 0, 0, 0);
+	setBaseline(MAG, 0.2, 0, 0.4);
+	for (int i = 0; i < 3; i++)
+		setTemperatureCoefficient((sensor) i, 0, 0, 0);
+
+	for (int i = 0; i < 3; i++)
+		hpfLow[i] = 0;
+	for (int i = 0; i < 2; i++) {
+		intGenCount[i] = 0;
+		intGenSrc[i] = 0;
+	}
+}
+
+SimLSM9DS0::~SimLSM9DS0() {
+	delete gyro;
+	delete xm;
+}
+
+I2cBus *SimLSM9DS0::gyroBus() {
+	return gyro;
+}
+
+I2cBus *SimLSM9DS0::xmBus() {
+	return xm;
+}
+
+int64_t SimLSM9DS0::now() {
+	return __atomic_load_n(&clock, __ATOMIC_RELAXED);
+}
+
+void SimLSM9DS0::sleep(int64_t ns) {
+	if (ns > 0)
+		__atomic_store_n(&clock, clock + ns, __ATOMIC_RELAXED);
+	catchUp();
+}
+
+bool SimLSM9DS0::waitInterrupt(pin p, int64_t timeout_ns) {
+	int64_t deadline = clock + timeout_ns;
+	bool level = pinLevel(p);
+	for (;;) {
+		// Pins only change when a sample arrives, so step sample to sample
+		int64_t next = -1;
+		if (aNext >= 0)
+			next = aNext;
+		if (gNext >= 0 && (next < 0 || gNext < next))
+			next = gNext;
+		if (mNext >= 0 && (next < 0 || mNext < next))
+			next = mNext;
+		if (next < 0 || next > deadline) {
+			__atomic_store_n(&clock, deadline, __ATOMIC_RELAXED);
+			catchUp();
+			return false;
+		}
+		if (next > clock)
+			__atomic_store_n(&clock, next, __ATOMIC_RELAXED);
+		catchUp();
+		bool now = pinLevel(p);
+		if (now && !level)
+			return true;
+		level = now;
+	}
+}
+
+void SimLSM9DS0::setBusSpeed(int hz) {
+	bus_hz = hz;
+}
+
+void SimLSM9DS0::setNoise(sensor s, float sigma) {
+	noise[s] = sigma;
+}
+
+void SimLSM9DS0::setBaseline(sensor s, float x, float y, float z) {
+	baseline[s][0] = x;
+	baseline[s][1] = y;
+	baseline[s][2] = z;
+}
+
+void SimLSM9DS0::setTemperature(float celsius) {
+	temp = celsius;
+	tempStart = clock;
+}
+
+void SimLSM9DS0::setTemperatureRate(float celsius_per_s) {
+	temp = temperature(clock); // the new rate starts from here
+	tempStart = clock;
+	tempRate = celsius_per_s;
+}
+
+void SimLSM9DS0::setTemperatureCoefficient(sensor s, float x, float y, float z) {
+	tempCoefficient[s][0] = x;
+	tempCoefficient[s][1] = y;
+	tempCoefficient[s][2] = z;
+}
+
+void SimLSM9DS0::addMotion(sensor s, int axis, int64_t start_ns,
+		int64_t duration_ns, float amplitude, float frequency_hz) {
+	motion m;
+	m.s = s;
+	m.axis = axis;
+	m.start = start_ns;
+	m.duration = duration_ns;
+	m.amplitude = amplitude;
+	m.frequency = frequency_hz;
+	motions.push_back(m);
+}
+
+uint64_t SimLSM9DS0::transactions() {
+	return transaction_count;
+}
+
+uint64_t SimLSM9DS0::accelSamples() {
+	return aSamples;
+}
+
+uint64_t SimLSM9DS0::accelSamplesLost() {
+	return aLost;
+}
+
+void SimLSM9DS0::transaction(int bytes) {
+	transaction_count++;
+	clockBytes(bytes + 3); // address, register and repeated address, then data
+}
+
+void SimLSM9DS0::clockBytes(int bytes) {
+	if (bus_hz > 0)
+		__atomic_store_n(&clock, clock + (int64_t) bytes * 9 * 1000000000LL / bus_hz,
+				__ATOMIC_RELAXED);
+	catchUp();
+}
+
+uint8_t SimLSM9DS0::read(bool isGyro, uint8_t reg) {
+	if (reg >= 0x40)
+		return 0;
+
+	if (isGyro) {
+		switch (reg) {
+		case STATUS_REG_G:
+			return (gUnread ? 0x0F : 0) | (gOverrun ? 0xF0 : 0);
+		case OUT_Z_H_G:
+			gUnread = gOverrun = false;
+			break;
+		}
+		return gRegs[reg];
+	}
+
+	switch (reg) {
+	case STATUS_REG_M:
+		return (mUnread ? 0x0F : 0) | (mOverrun ? 0xF0 : 0);
+	case OUT_Z_H_M:
+		mUnread = mOverrun = false;
+		break;
+	case STATUS_REG_A:
+		return (aUnread ? 0x0F : 0) | (aOverrun ? 0xF0 : 0);
+	case FIFO_SRC_REG:
+		return fifoSource();
+	case OUT_TEMP_L_XM: { // latch both halves, 8 LSB per degree, 12 bits right-justified
+		int16_t t = (int16_t) lroundf(temperature(clock) * 8) & 0x0FFF;
+		xmRegs[OUT_TEMP_L_XM] = t & 0xFF;
+		xmRegs[OUT_TEMP_H_XM] = t >> 8;
+		break;
+	}
+	case INT_GEN_1_SRC:
+	case INT_GEN_2_SRC: {
+		int n = reg == INT_GEN_2_SRC;
+		uint8_t src = intGenSrc[n];
+		if (xmRegs[CTRL_REG5_XM] & (n ? 0x02 : 0x01)) // latched: clear on read
+			intGenSrc[n] &= ~0x40;
+		return src;
+	}
+	}
+
+	if (reg >= OUT_X_L_A && reg <= OUT_Z_H_A) {
+		uint8_t value = xmRegs[reg];
+		if (fifoEnabled() && fifoCount > 0) {
+			int16_t v = fifo[fifoHead][(reg - OUT_X_L_A) / 2];
+			value = (reg & 1) ? (uint8_t) (v >> 8) : (uint8_t) (v & 0xFF);
+		}
+		if (reg == OUT_Z_H_A) {
+			aUnread = aOverrun = false;
+			if (fifoEnabled() && fifoCount > 0) {
+				fifoHead = (fifoHead + 1) % 32;
+				fifoCount--;
+				fifoOverrun = false;
+			}
+		}
+		return value;
+	}
+
+	return xmRegs[reg];
+}
+
+void SimLSM9DS0::write(bool isGyro, uint8_t reg, uint8_t data) {
+	if (reg >= 0x40)
+		return;
+
+	if (isGyro) {
+		int64_t period = gyroPeriod();
+		gRegs[reg] = data;
+		if (gyroPeriod() != period)
+			gNext = gyroPeriod() ? clock + gyroPeriod() : -1;
+		return;
+	}
+
+	int64_t aPeriod = accelPeriod();
+	int64_t mPeriod = magPeriod();
+	xmRegs[reg] = data;
+	if (accelPeriod() != aPeriod)
+		aNext = accelPeriod() ? clock + accelPeriod() : -1;
+	if (magPeriod() != mPeriod)
+		mNext = magPeriod() ? clock + magPeriod() : -1;
+
+	// Bypass mode and disabling the FIFO both empty it
+	if ((reg == FIFO_CTRL_REG || reg == CTRL_REG0_XM) &&
+			(!fifoEnabled() || (xmRegs[FIFO_CTRL_REG] >> 5) == 0)) {
+		fifoHead = fifoCount = 0;
+		fifoOverrun = false;
+	}
+}
+
+uint8_t SimLSM9DS0::nextReg(bool isGyro, uint8_t reg) {
+	// In FIFO mode, reads roll over from OUT_Z_H_A to OUT_X_L_A so the whole
+	// FIFO can be drained in one burst
+	if (!isGyro && reg == OUT_Z_H_A && fifoEnabled())
+		return OUT_X_L_A;
+	return (reg + 1) & 0x7F;
+}
+
+void SimLSM9DS0::catchUp() {
+	// The sensors are independent, so each can catch up on its own
+	while (aNext >= 0 && aNext <= clock) {
+		accelSample(aNext);
+		aNext += accelPeriod();
+	}
+	while (gNext >= 0 && gNext <= clock) {
+		gyroSample(gNext);
+		gNext += gyroPeriod();
+	}
+	while (mNext >= 0 && mNext <= clock) {
+		magSample(mNext);
+		mNext += magPeriod();
+	}
+}
+
+int64_t SimLSM9DS0::accelPeriod() {
+	int aodr = xmRegs[CTRL_REG1_XM] >> 4;
+	if (aodr == 0 || aodr > 10)
+		return 0;
+	return (int64_t) (1e9 / accel_odr_hz[aodr]);
+}
+
+int64_t SimLSM9DS0::gyroPeriod() {
+	if (!(gRegs[CTRL_REG1_G] & 0x08)) // PD: powered down
+		return 0;
+	return (int64_t) (1e9 / gyro_odr_hz[gRegs[CTRL_REG1_G] >> 6]);
+}
+
+int64_t SimLSM9DS0::magPeriod() {
+	if (xmRegs[CTRL_REG7_XM] & 0x03) // MD: only continuous conversion
+		return 0;
+	if (xmRegs[CTRL_REG7_XM] & 0x04) // MLP: low power
+		return (int64_t) (1e9 / mag_odr_hz[0]);
+	int m_odr = (xmRegs[CTRL_REG5_XM] >> 2) & 0x07;
+	if (m_odr > 5)
+		return 0;
+	return (int64_t) (1e9 / mag_odr_hz[m_odr]);
+}
+
+void SimLSM9DS0::accelSample(int64_t t) {
+	int afs = (xmRegs[CTRL_REG2_XM] >> 3) & 0x07;
+	float fs = accel_fs[afs > 4 ? 4 : afs];
+	int16_t raw[3];
+	for (int i = 0; i < 3; i++) {
+		raw[i] = to_raw(sample(ACCEL, i, t), fs);
+		xmRegs[OUT_X_L_A + 2 * i] = raw[i] & 0xFF;
+		xmRegs[OUT_X_H_A + 2 * i] = (uint16_t) raw[i] >> 8;
+	}
+	aSamples++;
+
+	int mode = xmRegs[FIFO_CTRL_REG] >> 5;
+	if (fifoEnabled() && mode != 0) {
+		int depth = 32;
+		if (xmRegs[CTRL_REG0_XM] & 0x20) { // WTM_EN: depth limited to WTM
+			depth = xmRegs[FIFO_CTRL_REG] & 0x1F;
+			if (depth == 0)
+				depth = 1;
+		}
+		bool store = true;
+		if (fifoCount == depth) {
+			fifoOverrun = true;
+			aLost++;
+			if (mode == 1) { // FIFO mode stops when full
+				store = false;
+			} else { // stream modes drop the oldest sample
+				fifoHead = (fifoHead + 1) % 32;
+				fifoCount--;
+			}
+		}
+		if (store) {
+			for (int i = 0; i < 3; i++)
+				fifo[(fifoHead + fifoCount) % 32][i] = raw[i];
+			fifoCount++;
+		}
+	} else if (aUnread) {
+		aLost++;
+	}
+	if (aUnread)
+		aOverrun = true;
+	aUnread = true;
+
+	// The interrupt generators' high-pass filter, roughly the reference
+	// filter at the lowest cutoff
+	if (!hpfPrimed) {
+		for (int i = 0; i < 3; i++)
+			hpfLow[i] = raw[i];
+		hpfPrimed = true;
+	} else {
+		for (int i = 0; i < 3; i++)
+			hpfLow[i] += (raw[i] - hpfLow[i]) / 64;
+	}
+	intGen(0, raw);
+	intGen(1, raw);
+}
+
+void SimLSM9DS0::gyroSample(int64_t t) {
+	float fs = gyro_fs[(gRegs[CTRL_REG4_G] >> 4) & 0x03];
+	for (int i = 0; i < 3; i++) {
+		int16_t raw = to_raw(sample(GYRO, i, t), fs);
+		gRegs[OUT_X_L_G + 2 * i] = raw & 0xFF;
+		gRegs[OUT_X_H_G + 2 * i] = (uint16_t) raw >> 8;
+	}
+	if (gUnread)
+		gOverrun = true;
+	gUnread = true;
+}
+
+void SimLSM9DS0::magSample(int64_t t) {
+	float fs = mag_fs[(xmRegs[CTRL_REG6_XM] >> 5) & 0x03];
+	for (int i = 0; i < 3; i++) {
+		int16_t raw = to_raw(sample(MAG, i, t), fs);
+		xmRegs[OUT_X_L_M + 2 * i] = raw & 0xFF;
+		xmRegs[OUT_X_H_M + 2 * i] = (uint16_t) raw >> 8;
+	}
+	if (mUnread)
+		mOverrun = true;
+	mUnread = true;
+}
+
+void SimLSM9DS0::intGen(int n, const int16_t *raw) {
+	uint8_t cfg = xmRegs[n ? INT_GEN_2_REG : INT_GEN_1_REG];
+	uint8_t enabled = cfg & 0x3F;
+	bool latched = xmRegs[CTRL_REG5_XM] & (n ? 0x02 : 0x01);
+	if (!enabled) {
+		intGenCount[n] = 0;
+		if (!latched)
+			intGenSrc[n] = 0;
+		return;
+	}
+
+	bool hpf = xmRegs[CTRL_REG0_XM] & (n ? 0x01 : 0x02);
+	int32_t ths = (xmRegs[n ? INT_GEN_2_THS : INT_GEN_1_THS] & 0x7F) * 256;
+	uint8_t events = 0;
+	for (int i = 0; i < 3; i++) {
+		float v = fabsf(hpf ? raw[i] - hpfLow[i] : raw[i]);
+		uint8_t high = 0x02 << (2 * i), low = 0x01 << (2 * i);
+		if ((enabled & high) && v > ths)
+			events |= high;
+		if ((enabled & low) && v <= ths)
+			events |= low;
+	}
+
+	bool active = (cfg & 0x80) ? events == enabled : events != 0;
+	intGenCount[n] = active ? intGenCount[n] + 1 : 0;
+	bool fired = active &&
+			intGenCount[n] > (xmRegs[n ? INT_GEN_2_DURATION : INT_GEN_1_DURATION] & 0x7F);
+
+	// A latched interrupt holds its source until it's read
+	if (latched && (intGenSrc[n] & 0x40))
+		return;
+	intGenSrc[n] = (fired ? 0x40 : 0) | events;
+}
+
+float SimLSM9DS0::sample(sensor s, int axis, int64_t t) {
+	float v = baseline[s][axis];
+	if (tempCoefficient[s][axis] != 0)
+		v += tempCoefficient[s][axis] * (temperature(t) - 25);
+	if (noise[s] > 0)
+		v += noise[s] * gaussian();
+	for (size_t i = 0; i < motions.size(); i++) {
+		const motion &m = motions[i];
+		if (m.s != s || m.axis != axis || t < m.start || t >= m.start + m.duration)
+			continue;
+		if (m.frequency == 0)
+			v += m.amplitude;
+		else
+			v += m.amplitude * sinf(2 * M_PI * m.frequency * ((t - m.start) / 1e9));
+	}
+	return v;
+}
+
+float SimLSM9DS0::temperature(int64_t t) {
+	return temp + tempRate * ((t - tempStart) / 1e9);
+}
+
+float SimLSM9DS0::gaussian() {
+	if (haveSpare) {
+		haveSpare = false;
+		return spare;
+	}
+	// Box-Muller over xorshift64*
+	double u[2];
+	for (int i = 0; i < 2; i++) {
+		rng ^= rng >> 12;
+		rng ^= rng << 25;
+		rng ^= rng >> 27;
+		u[i] = ((rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+	}
+	double r = sqrt(-2 * log(1 - u[0]));
+	spare = r * sin(2 * M_PI * u[1]);
+	haveSpare = true;
+	return r * cos(2 * M_PI * u[1]);
+}
+
+bool SimLSM9DS0::fifoEnabled() {
+	return xmRegs[CTRL_REG0_XM] & 0x40;
+}
+
+uint8_t SimLSM9DS0::fifoSource() {
+	uint8_t wtm = xmRegs[FIFO_CTRL_REG] & 0x1F;
+	uint8_t src = fifoCount < 31 ? fifoCount : 31;
+	if (fifoCount == 0)
+		src |= 0x20;
+	if (fifoOverrun)
+		src |= 0x40;
+	if (wtm && fifoCount >= wtm)
+		src |= 0x80;
+	return src;
+}
+
+bool SimLSM9DS0::pinLevel(pin p) {
+	bool ia1 = intGenSrc[0] & 0x40, ia2 = intGenSrc[1] & 0x40;
+	if (p == INT1_XM) {
+		uint8_t c = xmRegs[CTRL_REG3_XM];
+		return ((c & 0x20) && ia1) || ((c & 0x10) && ia2) ||
+				((c & 0x04) && aUnread) || ((c & 0x02) && mUnread) ||
+				((c & 0x01) && fifoEnabled() && fifoCount == 0);
+	}
+	uint8_t c = xmRegs[CTRL_REG4_XM];
+	return ((c & 0x40) && ia1) || ((c & 0x20) && ia2) ||
+			((c & 0x08) && aUnread) || ((c & 0x04) && mUnread) ||
+			((c & 0x02) && fifoOverrun) || ((c & 0x01) && (fifoSource() & 0x80));
+}
+
+static int16_t to_raw(float value, float fs) {
+	long raw = lroundf(value * 32768 / fs);
+	if (raw > 32767)
+		raw = 32767;
+	if (raw < -32768)
+		raw = -32768;
+	return (int16_t) raw;
+}
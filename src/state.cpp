@@ -0,0 +1,130 @@
+/*
+ * state.cpp
+ *
+ * still's latest state, in a shared mapping under a seqlock
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "state.h"
+
+struct still_state *state_create(const char *path, const struct still_state *s) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+		return NULL;
+	if(ftruncate(fd, sizeof(struct still_state)) < 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return NULL;
+	}
+	void *map = mmap(NULL, sizeof(struct still_state), PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	int e = errno;
+	close(fd); // the mapping keeps the file
+	if(map == MAP_FAILED) {
+		errno = e;
+		return NULL;
+	}
+
+	struct still_state *m = (struct still_state *) map;
+	*m = *s;
+	memcpy(m->magic, STATE_MAGIC, sizeof(m->magic));
+	m->version = STATE_VERSION;
+	m->size = sizeof(struct still_state);
+	m->seq = 0;
+	m->triggers = 0;
+	m->triggered_ns = -1;
+	return m;
+}
+
+// The seqlock: the counter goes odd before any data changes and even after
+// all of it has, so a reader that saw the same even count on both sides of
+// its copy copied no write.
+
+void state_begin(struct still_state *s) {
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void state_end(struct still_state *s) {
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+void state_append(struct still_state *s, int d, const struct state_sample *p) {
+	struct state_device *dev = s->device_state + d;
+	dev->latest = *p;
+	dev->history[dev->written % STATE_HISTORY] = *p;
+	dev->written++;
+	dev->samples++;
+	if(p->deviation == p->deviation) { // decided, not NAN
+		dev->decided++;
+		dev->deviation_mean += (p->deviation - dev->deviation_mean) / dev->decided;
+		if(p->deviation > dev->deviation_max)
+			dev->deviation_max = p->deviation;
+	}
+}
+
+void state_decision(struct still_state *s, int d, bool moved, float deviation,
+		int64_t now_ns) {
+	s->moved = moved;
+	s->device = d;
+	s->deviation = deviation;
+	s->decided_ns = now_ns;
+	if(moved) {
+		s->triggers++;
+		s->triggered_ns = now_ns;
+	}
+}
+
+const struct still_state *state_open(const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return NULL;
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return NULL;
+	}
+	if((size_t) st.st_size < sizeof(struct still_state)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	void *map = mmap(NULL, sizeof(struct still_state), PROT_READ, MAP_SHARED, fd, 0);
+	int e = errno;
+	close(fd);
+	if(map == MAP_FAILED) {
+		errno = e;
+		return NULL;
+	}
+
+	const struct still_state *s = (const struct still_state *) map;
+	if(memcmp(s->magic, STATE_MAGIC, sizeof(s->magic)) || s->version != STATE_VERSION ||
+			s->size != sizeof(struct still_state)) {
+		munmap(map, sizeof(struct still_state));
+		errno = EINVAL;
+		return NULL;
+	}
+	return s;
+}
+
+void state_read(const struct still_state *s, void *dst, const void *src, size_t n) {
+	for(;;) {
+		uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if(seq & 1) // a write is under way, and only takes a few stores
+			continue;
+		memcpy(dst, src, n);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq)
+			return;
+	}
+}
@@ -14,41 +14,279 @@
  * --discard ms: discard all sensor readings for the first ms milliseconds
  * --threshold t: trigger threshold for deviation from calibrated mean,
  * 		as a fraction of the calibrated mean magnitude
+ * --detector d: how to compare the sample buffer to the calibrated mean:
+ * 		boxcar (buffer mean), sum (buffer mean from running sums),
+ * 		welford (running mean and variance), ewma (moving average),
+ * 		int (buffer mean from integer running sums of raw readings),
+ * 		band (vibration in the --bands, from a sliding DFT of the buffer)
+ * --bands lo-hi[,lo-hi...]: frequency bands (Hz) the band detector watches,
+ * 		20-200 (drilling, cutting) by default.  It triggers once the amplitude
+ * 		of the vibration in any band has grown by the threshold (as a
+ * 		fraction of the calibrated mean's magnitude, so in g's) since
+ * 		calibration.  Its resolution is the ODR over the buffer size, and it
+ * 		only sees up to half the ODR: every band needs at least one bin.  At
+ * 		most 32 bins are watched in all, so a sample costs the same at any ODR:
+ * 		wider bands are watched over fewer of the newest samples instead.
+ *
+ * Tracking the baseline:
+ * --track s: follow slow drift of the calibrated mean (e.g. as the sun warms
+ * 		the board) with a time constant of s seconds, but only while the
+ * 		deviation is confirmed quiet.  Movement raises the deviation before
+ * 		the mean can follow it, which stops the tracking until it's quiet
+ * 		again, so movement is never tracked away.  0 (the default) keeps the
+ * 		calibrated mean fixed.
+ * --track-quiet f: deviation, as a fraction of --threshold, that samples must
+ * 		stay under to be quiet
+ * --track-confirm s: seconds every sample must have been quiet before the
+ * 		mean follows them
+ * --temperature ms: with --track, read the temperature every ms milliseconds,
+ * 		fit how the quiet mean moves with it, and move the calibrated mean
+ * 		along the fit as the temperature changes, even while tracking is
+ * 		stopped.  0 tracks without the temperature.
+ *
+ * Tracking costs O(1) per sample: the detectors see the tracked mean once per
+ * buffer of samples.
+ *
+ * Keeping watch:
+ * --keep-going: don't stop at the first movement: start the command without
+ * 		waiting for it and keep sampling, with no new discard or calibration
+ * --rule deviation[:cooldown[:debounce]]=command: implies --keep-going, and
+ * 		runs command with /bin/sh -c once the deviation from the calibrated
+ * 		mean (as a fraction of its magnitude, like --threshold) has reached
+ * 		deviation for debounce samples.  May be given more than once: the most
+ * 		severe rule ready fires, and also starts the cooldown (ms) of every
+ * 		milder rule.  A rule doesn't fire while its last command still runs.
+ * 		The command given after the options is a rule at --threshold.
+ * 		Commands see the deviation in $STILL_DEVIATION.
+ * --cooldown ms: cooldown of rules that don't give one
+ * --debounce n: debounce of rules that don't give one
+ *
+ * Sampling the accelerometer:
+ * --odr hz: accelerometer output data rate: 3.125, 6.25, 12.5, 25, 50, 100,
+ * 		200, 400, 800 or 1600 Hz
+ * --abw hz: accelerometer anti-alias filter bandwidth: 773, 362, 194 or 50 Hz,
+ * 		by default the widest that's no more than half the ODR
+ * --scale g: accelerometer full scale: 2, 4, 6, 8 or 16 g (2).  Readings past
+ * 		it overflow, which triggers like movement; larger scales are coarser.
+ * --i2c-speed hz: clock the I2C bus at 100000 (standard mode) or 400000 (fast
+ * 		mode) Hz.  Fast mode is needed for more than one accelerometer on a bus
+ * 		at 1600 Hz.  still refuses to start if its buses (at a known speed,
+ * 		and simulated ones) can't carry the samples.
+ * --delay ms: sleep ms milliseconds when no new sample is available.  Polling
+ * 		the FIFO, it defaults to at most the time the FIFO takes to fill half
+ * 		of what the --watermark leaves, and must be less than all of it.
+ * --fifo: buffer samples in the accelerometer's FIFO (stream mode) and
+ * 		drain them in batches.  Implied when polling with a --delay over half
+ * 		the ODR's sample period (from 100 Hz by default), so that high-rate
+ * 		capture doesn't lose samples between polls.
+ * --watermark n: only drain the FIFO once it holds n samples, implies --fifo
+ * --irq-gpio n: sleep until the accelerometer raises an interrupt on mraa
+ * 		GPIO pin n instead of polling every --delay ms.  The pin must be wired
+ * 		to INT1_XM (data ready), or to INT2_XM (FIFO watermark) with --watermark
+ *
+ * Watching the gyroscope and magnetometer:
+ * --gyro t: also trigger on rotation, once the gyroscope's window mean is t
+ * 		degrees per second away from its calibrated mean
+ * --gyro-odr hz: gyroscope output data rate: 95, 190, 380 or 760 Hz
+ * --mag t: also trigger on a change in the magnetic field (e.g. a magnet
+ * 		held to the board), as a fraction of the calibrated field's magnitude
+ * --mag-odr hz: magnetometer output data rate: 3.125, 6.25, 12.5, 25, 50
+ * 		or 100 Hz
+ * --combine c: how to combine the sensors' decisions: any (trigger when any
+ * 		sensor has moved), all (only when every sensor has), or weighted
+ * 		(when the weighted sum of each sensor's distance as a fraction of its
+ * 		threshold reaches 1)
+ * --weights a,g,m: weights of the accelerometer, gyroscope and magnetometer
+ * 		for --combine weighted
+ *
+ * Each sensor calibrates over its own --buffer samples with the --detector
+ * (sum in place of int), and is read on its own schedule from its ODR in
+ * one burst with its status register, so a sensor without new data costs a
+ * single read.  With --hw-detect the gyroscope and magnetometer are only
+ * read when the interrupt generators are checked.
+ *
+ * Watching several devices:
+ * --device bus[:gyro_addr:xm_addr]: watch the LSM9DS0 on mraa I2C bus bus at
+ * 		the given addresses, 0x6B:0x1D by default or 0x6A:0x1E with SDO
+ * 		pulled low, instead of the one on bus 1 at the defaults.  May be given
+ * 		more than once: every bus is then sampled in parallel, and every
+ * 		device calibrates and detects on its own, while
+ * 		the trigger, the rules and the watchdog are shared.  Any device moving
+ * 		triggers; with --keep-going, the rules see the largest deviation of
+ * 		any device.  More than one device doesn't support --irq-gpio,
+ * 		--hw-detect, --gyro or --mag.
+ *
+ * Every bus is sampled by its own acquisition thread, which only reads and
+ * timestamps batches into a wait-free ring for the detection thread, so a
+ * slow detector can't make still miss samples.  If the detectors fall so far
+ * behind that the ring fills, batches are dropped (and counted in --stats)
+ * and the next one is flagged as an overflow.  Only --irq-gpio, --hw-detect,
+ * --gyro and --mag read and detect in one loop instead.
+ *
+ * Detecting in hardware:
+ * --hw-detect: once calibrated, let the accelerometer's interrupt generators
+ * 		watch for movement and only read samples to confirm an event
+ * --hw-hpf: feed the interrupt generators through the high-pass filter
+ * --hw-duration n: samples an event must last before the generators fire
+ * --health ms: how often to check the generators (and prove to the watchdog
+ * 		that the IMU still answers) while waiting, or how long to wait for an
+ * 		interrupt with --irq-gpio.  Must be under a third of the watchdog
+ * 		--timeout, which is how often the feeder wants a heartbeat.
+ *
+ * Running in real time:
+ * --realtime: lock all memory (mlockall), prefault the stack and sample
+ * 		buffers, and run under SCHED_FIFO so page faults and other processes
+ * 		can't delay sampling.  Commands started by rules drop back to the
+ * 		normal scheduler; a command exec'd by the trigger keeps still's
+ * 		priority.  Also sleeps --delay ms between polls during calibration,
+ * 		rather than spinning at real-time priority.
+ * --priority n: SCHED_FIFO priority, implies --realtime
+ * --cpu n: pin still to CPU n
+ *
+ * The command is looked up on PATH once, at startup, so triggering is a
+ * direct execve.
  *
  * Using the watchdog timer
- * --watchdog: open /dev/watchdog and write to it for every sample
+ * --watchdog: open /dev/watchdog and keep it alive from a feeder thread every
+ * 		third of the timeout, but only while every device's samples keep
+ * 		making it through the detector.  A hung I2C read or a stuck loop stops
+ * 		the feeding, and the watchdog resets the board.
  * --timeout t: set the trigger timeout for /dev/watchdog, implies --watchdog
+ *
+ * Simulating the LSM9DS0:
+ * --simulate: run against a simulated LSM9DS0 on a virtual clock instead of
+ * 		the hardware, as fast as the CPU allows.  Builds without mraa always
+ * 		simulate.  --irq-gpio waits on the simulated interrupt pin.
+ * --sim-seed n: seed for the simulated noise
+ * --sim-noise g: standard deviation of the simulated accelerometer noise
+ * --sim-bus hz: simulated I2C bus speed, 0 for free transactions.  --i2c-speed
+ * 		overrides it.
+ * --sim-motion [device/][sensor:]start:duration:amplitude[:frequency[:axis]]:
+ * 		move the simulated accelerometer (or, with sensor gyro or mag,
+ * 		gyroscope or magnetometer) of the device'th --device (default the
+ * 		first) by amplitude g's (dps, gauss) along axis (x, y or z, default x)
+ * 		from start ms for duration ms, as a sine wave of frequency Hz or, if
+ * 		frequency is 0, a step.  May be given more than once.
+ * --sim-temp celsius[:rate[:coefficient]]: simulated temperature, changing by
+ * 		rate degrees per minute, and offsetting every axis of the
+ * 		accelerometer by coefficient g per degree away from 25
+ * --sim-duration ms: give up with exit status 1 if nothing has triggered after
+ * 		ms milliseconds of simulated time, 0 to run forever
+ *
+ * Every --device gets its own simulated LSM9DS0, seeded with --sim-seed plus
+ * its index.  Devices on the same bus share its virtual clock, and every bus
+ * has its own.
+ *
+ * Recording samples:
+ * --record file: record every raw accelerometer sample read, with its
+ * 		status and time, to a ring in file through a shared mapping, so
+ * 		recording costs no syscalls.  The header holds the ODR, scale,
+ * 		threshold, buffer, discard time, detector, bands and each device's
+ * 		calibration.  The mapping is written back about once a second.  With
+ * 		--realtime it's locked in memory like everything else.
+ * --record-size n: samples the ring holds before overwriting the oldest
+ *
+ * Streaming samples:
+ * --stream path: serve every raw accelerometer batch read to any number of
+ * 		local subscribers on a SOCK_SEQPACKET Unix domain socket at path, so
+ * 		other tools can share the LSM9DS0 without touching the bus.  Each
+ * 		subscriber first receives a stream_hello (ODR, scale, g per tick;
+ * 		see include/stream.h), then one stream_frame per batch: a sequence
+ * 		number, the read time, the device, the status and the raw samples.
+ * 		Frames are never waited for: a subscriber that falls about 256 KB
+ * 		behind is disconnected and must reconnect.  Without a command or
+ * 		--rule, still only streams, and keeps sampling until it's killed.
+ *
+ * Sharing the latest state:
+ * --shm file: publish every device's latest calibrated sample (g, and its
+ * 		deviation from the calibrated mean), the last STATE_HISTORY (256) of
+ * 		them, running statistics (samples, overflows, mean and largest
+ * 		deviation) and the trigger's latest decision through a shared
+ * 		mapping of file, e.g. /dev/shm/still.  Writes are guarded by a
+ * 		seqlock, so readers in other processes never make a syscall or hold
+ * 		still up: they map the file with state_open() and copy what they
+ * 		need with state_read() (see include/state.h).  The file stays behind
+ * 		after a trigger, showing the movement.
+ *
+ * Replaying recordings:
+ * --replay file: instead of sampling, run the samples recorded to file by
+ * 		--record through the same calibration and detectors, as fast as the
+ * 		CPU allows.  The discard time is measured on the recorded timestamps.
+ * 		--buffer, --threshold, --discard, --detector and --bands default to
+ * 		what the recording was made with.  Prints each trigger point as a
+ * 		line of JSON on stdout (time since sampling started, device, sample
+ * 		index, why and the deviation) and stops at the first, exiting 0, or
+ * 		exits 1 if nothing triggered.  With --keep-going, prints the start of
+ * 		every movement and its end (why is "still") instead, so every
+ * 		decision can be told from the output; no commands or rules run.
+ *
+ * Measuring performance:
+ * --stats: print run statistics as one line of JSON on stderr when exiting:
+ * 		samples read, wakeups, detector time (and the xyz_block kernels
+ * 		compiled in: ssse3, sse2 or scalar), batches dropped from the
+ * 		acquisition rings and their fullest level, stream subscribers
+ * 		connected, served and dropped, and with --simulate the
+ * 		simulated time, bus transactions, lost samples and the first
+ * 		movement's start.  `make bench` collects them across ODRs and buffer
+ * 		sizes.
+ * --latency file: time every stage from data ready to exec into histograms,
+ * 		and write them to file on SIGUSR1 and on exit.  Stages are read (data
+ * 		ready observed to burst read complete), queue (burst read complete to
+ * 		the detection thread taking the batch off its bus's ring; empty when
+ * 		one loop reads and detects), detect (taken off the ring, or read, to
+ * 		the detector's decisions on the batch), exec (decision to execve)
+ * 		and total (data ready to decision), plus the interval between batches,
+ * 		its jitter against the ODR, and counts of late samples (a batch read
+ * 		more than one ODR period after --watermark samples were ready) and
+ * 		missed samples (estimated on every overflow), all across devices.
+ * 		Times are on the virtual clock with --simulate, each device's on its
+ * 		bus's; a simulated bus runs ahead of the detectors until its ring is
+ * 		full, so there queue, detect and total measure that lead rather
+ * 		than the CPU.
  */
 
 #include <iostream>
+#include <algorithm>
 #include <unistd.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 #include <math.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <errno.h>
+#include <semaphore.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <linux/watchdog.h>
 #include <boost/program_options.hpp>
 #include <boost/format.hpp>
+#ifndef NO_MRAA
+#include "mraa.hpp"
+#endif
 
 #include "SFE_LSM9DS0.h"
+#include "sim_lsm9ds0.h"
+#include "xyz.h"
+#include "detector.h"
+#include "histogram.h"
+#include "action.h"
+#include "channel.h"
+#include "sample_ring.h"
+#include "recording.h"
+#include "stream.h"
+#include "state.h"
+#include "baseline.h"
 
 namespace po = boost::program_options;
 
 using namespace std; // typing std:: all the time is annoying
 
 /*
- * A simple (x,y,z) coordinate
- */
-struct xyz {
-	float x;
-	float y;
-	float z;
-};
-
-/*
- * The LSM9DS0 interface as implemented by SparkFun
+ * The LSM9DS0 interface as implemented by SparkFun, for the first device
  */
 static LSM9DS0 *imu;
 
@@ -57,6 +295,24 @@ static LSM9DS0 *imu;
  * instead of execvp'ing a command.
  */
 static char **trigger_command;
+/*
+ * trigger_command[0] resolved against PATH
+ */
+static char *trigger_path;
+
+/*
+ * Keep sampling after movement, running rules instead of exiting?
+ */
+static bool keep_going = false;
+/*
+ * Cooldown (ms) and debounce (samples) for rules that don't give their own
+ */
+static int rule_cooldown_ms = 5000;
+static int rule_debounce = 1;
+/*
+ * The action rules, most severe first
+ */
+static vector<struct action_rule> rules;
 
 /*
  * The number of xyz samples to buffer for noise smoothing
@@ -66,6 +322,11 @@ static int xyz_buf_size = 8;
  * Duration after startup when all samples should be discarded
  */
 static int discard_time = 1000;
+/*
+ * When sampling started on clock_ns(): the discard time counts from here, and
+ * recordings are timed against it
+ */
+static int64_t sampling_start_ns;
 /*
  * Trigger threshold, specified as a fraction of the magnitude of the calibrated
  * mean (x,y,z) coordinate.  If the distance from the calibrated mean to the current mean
@@ -73,15 +334,110 @@ static int discard_time = 1000;
  * is triggered.
  */
 static float threshold = 0.01;
+/*
+ * Name of the detector to use, see make_detector()
+ */
+static string detector_name = "boxcar";
+/*
+ * Frequency bands for the band detector
+ */
+static vector<struct band> bands;
+/*
+ * Time constant (s) of baseline tracking, or 0 not to track
+ */
+static float track_tau_s = 0;
+/*
+ * Deviation, as a fraction of threshold, samples must stay under to be quiet
+ */
+static float track_quiet = 0.5;
+/*
+ * Time (s) every sample must have been quiet before the baseline follows them
+ */
+static float track_confirm_s = 10;
+/*
+ * How often to read the temperature while tracking (ms), or 0 never to
+ */
+static int temperature_interval_ms = 1000;
+
+/*
+ * An LSM9DS0 to watch, and its detector's state
+ */
+struct device {
+	int bus;					// mraa I2C bus number
+	uint8_t g_addr, xm_addr;	// gyroscope and accel/mag addresses
+	LSM9DS0 *imu;
+	SimLSM9DS0 *sim;			// or NULL on hardware
+	Detector *detector;			// watching xyz_buf, or NULL if raw_detector is used instead
+	RawDetector *raw_detector;	// watching raw_buf, or NULL if detector is used instead
+	struct xyz *xyz_buf;		// accelerometer samples
+	struct xyz_raw *raw_buf;	// raw accelerometer samples, parallel to xyz_buf
+	int xyz_buf_pos;			// position of the next sample in xyz_buf
+	int calibration_samples;	// samples (out of xyz_buf_size) collected for calibration
+	bool calibrated;
+	struct xyz calibrated_mean;
+	float calibrated_magnitude;
+	float g_per_lsb;			// g's per raw accelerometer tick
+	float deviation;			// at the last sample, with --keep-going
+	volatile uint32_t heartbeat;	// batches through the detector, for the watchdog
+	Baseline *baseline;			// tracking calibrated_mean once calibrated, with --track
+	uint32_t tracked_samples;	// samples since the detector last saw the tracked mean
+	int64_t temperature_due_ns;	// when to read the temperature next, with --temperature
+	bool ring_overrun;			// a batch was dropped from the bus's ring; its thread flags the next
+	int64_t last_ready_ns;		// when the last batch was seen ready, or -1 after a gap, with --latency
+};
+/*
+ * The devices to watch, from --device, or just bus 1 at 0x6B/0x1D
+ */
+static vector<struct device> devices;
+/*
+ * An I2C bus with devices to watch, sampled by its own thread
+ */
+struct bus {
+	int number;
+	vector<int> devices;		// indexes into devices
+	SimLSM9DS0 *sim;			// whose virtual clock the bus runs on, or NULL
+	SampleRing *ring;			// batches from the bus's thread to the detectors
+	pthread_t thread;
+};
+/*
+ * The buses with devices to watch, once their threads have started
+ */
+static vector<struct bus> buses;
+/*
+ * How many batches may wait for the detectors on each bus
+ */
+#define SAMPLE_RING_DEPTH 128
+/*
+ * Posted by the bus threads for every batch they add to a ring
+ */
+static sem_t batches_ready;
+/*
+ * Set to make the bus threads return
+ */
+static int buses_stopping = 0;
+/*
+ * The device that triggered, and how long the devices have been sampled
+ * (ns) by the latest batch, for the stats
+ */
+static int moved_device = 0;
+static int64_t devices_elapsed_ns = 0;
 
 /*
- * Array of accelerometer samples
+ * Is real-time mode enabled?
+ */
+static bool realtime = false;
+/*
+ * SCHED_FIFO priority in real-time mode
+ */
+static int realtime_priority = 50;
+/*
+ * CPU to pin still to, or -1 to let it run anywhere
  */
-static struct xyz *xyz_buf;
+static int realtime_cpu = -1;
 /*
- * Position of the next sample in xyz_buf
+ * How much stack real-time mode prefaults
  */
-static int xyz_buf_pos = 0;
+#define REALTIME_STACK_PREFAULT (64 * 1024)
 
 /*
  * Path to the watchdog timer device
@@ -99,6 +455,17 @@ static int watchdog_timeout = 2;
  * File descriptor of the open watchdog timer device
  */
 static int watchdog_fd;
+/*
+ * The watchdog feeder thread, and what wakes it up early to stop
+ */
+static pthread_t watchdog_thread;
+static pthread_mutex_t watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_wake = PTHREAD_COND_INITIALIZER;
+static bool watchdog_stopping = false;
+/*
+ * Times the feeder kept the watchdog alive
+ */
+static uint64_t watchdog_feeds = 0;
 
 /*
  * System clock (ms) when timestamp_ms() was first called
@@ -114,149 +481,934 @@ static bool timestamp_initialized = false;
  */
 static int sample_delay_ms = 10;
 /*
- * Return a timestamp in milliseconds.  Returns zero from
- * the first invocation, and the time since zero for all
- * subsequent invocations.
+ * Accelerometer output data rates by LSM9DS0::accel_odr, in Hz
  */
-static int64_t timestamp_ms();
-
+static const float accel_odr_hz[] = {
+	0, 3.125, 6.25, 12.5, 25, 50, 100, 200, 400, 800, 1600
+};
 /*
- * Read the accelerometer and write to a coordinate
+ * Accelerometer output data rate
  */
-static bool xyz_read_accel(struct xyz *p);
+static LSM9DS0::accel_odr accel_odr = LSM9DS0::A_ODR_50;
 /*
- * Add the coordinate values *q to those in *p, returning p
+ * Accelerometer anti-alias filter bandwidths by LSM9DS0::accel_abw, in Hz
  */
-static struct xyz *xyz_add(struct xyz *p, struct xyz *q);
+static const float accel_abw_hz[] = {
+	773, 194, 362, 50
+};
 /*
- * Subtract the coordinate values *q from this in *p, returning p
+ * Accelerometer anti-alias filter bandwidth, or -1 for the widest one that
+ * doesn't pass more than half the ODR
  */
-static struct xyz *xyz_subtract(struct xyz *p, struct xyz *q);
+static int accel_abw = -1;
 /*
- * Write the mean coordinate values of the n-length array starting
- * with *q into *p, returning p
+ * Accelerometer full scales by LSM9DS0::accel_scale, in g
  */
-static struct xyz *xyz_mean(struct xyz *p, struct xyz *q, int n);
+static const float accel_scale_g[] = {
+	2, 4, 6, 8, 16
+};
 /*
- * Return the magnitude of *p
+ * Accelerometer full scale; readings beyond it overflow
  */
-static float xyz_magnitude(struct xyz *p);
-
+static LSM9DS0::accel_scale accel_scale = LSM9DS0::A_SCALE_2G;
 /*
- * Main program entry
+ * I2C bus clock in Hz, or 0 to leave mraa's default
  */
-int main(int argc, char **argv);
+static int i2c_speed_hz = 0;
 
 /*
- * Parse command-line arguments and set options
+ * Gyroscope threshold (dps), or 0 to leave the gyroscope off
  */
-static void parse_args(int argc, char **argv);
+static float gyro_threshold = 0;
 /*
- * Initializes the watchdog timer and begins ticking
+ * Gyroscope output data rates by LSM9DS0::gyro_odr / 4 (the lowest bandwidth
+ * of each), in Hz
  */
-static void init_watchdog();
+static const float gyro_odr_hz[] = {
+	95, 190, 380, 760
+};
 /*
- * Trigger the command
+ * Gyroscope output data rate
  */
-static void trigger();
-
-int main(int argc, char** argv) {
-	// set options based on args
-	parse_args(argc, argv);
-
-	// coordinate buffer and means
-	xyz_buf = (struct xyz *) malloc(xyz_buf_size * sizeof(struct xyz));
-	struct xyz calibrated_mean;
-	struct xyz current_mean;
-	float calibrated_magnitude = 0;
-
-	// access the IMU
-	imu = new LSM9DS0(0x6B, 0x1D);
-	imu->begin();
-
-	// set IMU to 2G scale at 50Hz (IMU overflow will trigger the command)
-	imu->setAccelScale(LSM9DS0::A_SCALE_2G);
-	imu->setAccelODR(LSM9DS0::A_ODR_50);
-	imu->setAccelABW(LSM9DS0::A_ABW_50);
-
-	if(watchdog) // maybe initialize watchdog timer device
-		init_watchdog();
-
-
-	// how many samples (out of xyz_buf_size required) have been collected for calibration?
-	int calibration_samples = 0;
-	// has calibration finished?
-	bool calibrated = false;
-
-	for(;;) {
-		struct xyz *p = xyz_buf + xyz_buf_pos;
-		if((xyz_read_accel(p))) {
-			if(watchdog) // tick the watchdog if enabled
-				ioctl(watchdog_fd, WDIOC_KEEPALIVE, 0);
+static LSM9DS0::gyro_odr gyro_odr = LSM9DS0::G_ODR_95_BW_125;
+/*
+ * Magnetometer threshold, as a fraction of the calibrated field's magnitude,
+ * or 0 to leave the magnetometer off
+ */
+static float mag_threshold = 0;
+/*
+ * Magnetometer output data rates by LSM9DS0::mag_odr, in Hz
+ */
+static const float mag_odr_hz[] = {
+	3.125, 6.25, 12.5, 25, 50, 100
+};
+/*
+ * Magnetometer output data rate
+ */
+static LSM9DS0::mag_odr mag_odr = LSM9DS0::M_ODR_50;
+/*
+ * The gyroscope and magnetometer channels, or NULL while they're off
+ */
+static Channel *gyro_channel, *mag_channel;
+/*
+ * How the sensors' decisions combine into a trigger
+ */
+enum combine_mode {
+	COMBINE_ANY,
+	COMBINE_ALL,
+	COMBINE_WEIGHTED,
+};
+static combine_mode combine = COMBINE_ANY;
+/*
+ * Weights of the accelerometer, gyroscope and magnetometer for COMBINE_WEIGHTED
+ */
+static float combine_weights[3] = { 1, 1, 1 };
+/*
+ * The accelerometer's last decision, and its deviation from the calibrated
+ * mean as a fraction of its magnitude, for combining with the channels
+ */
+static bool accel_moved = false;
+static float accel_deviation = 0;
 
-			if(timestamp_ms() < discard_time) // discard early points for excessive noise
-				continue;
+/*
+ * Is the accelerometer FIFO enabled?
+ */
+static bool fifo = false;
+/*
+ * FIFO level to wait for before draining, or 0 to drain whatever is stored
+ */
+static int fifo_watermark = 0;
+/*
+ * mraa GPIO pin wired to the accelerometer interrupt, or -1 to poll instead
+ */
+static int irq_gpio = -1;
+/*
+ * Is still waiting for interrupts instead of polling?
+ */
+static bool irq = false;
+#ifndef NO_MRAA
+/*
+ * The interrupt GPIO
+ */
+static mraa::Gpio *irq_pin;
+#endif
+/*
+ * Posted by the interrupt handler for every edge on the interrupt GPIO
+ */
+static sem_t irq_sem;
+/*
+ * How long wait_irq() waits for an edge before polling anyway, in case
+ * the edge happened before the handler was armed
+ */
+#define IRQ_TIMEOUT_MS 250
 
-			xyz_buf_pos = (xyz_buf_pos + 1) % xyz_buf_size; // advance next buffer slot
+/*
+ * Is hardware detection enabled?
+ */
+static bool hw_detect = false;
+/*
+ * Should the interrupt generators see high-pass filtered data?
+ */
+static bool hw_hpf = false;
+/*
+ * Interrupt generator duration, in samples
+ */
+static int hw_duration = 0;
+/*
+ * Interval between interrupt generator checks while hardware detection is armed
+ */
+static int hw_health_ms = 500;
 
-			if(!calibrated) { // if still collecting calibration points
-				if(++calibration_samples == xyz_buf_size) { // if we got enough points
-					xyz_mean(&calibrated_mean, xyz_buf, xyz_buf_size); // calibrated mean
-					calibrated_magnitude = xyz_magnitude(&calibrated_mean); // calibrated magnitude
-					// renormalize the point buffer from the calibrated mean
-					for(int i = 0; i < xyz_buf_size; i++)
-						xyz_subtract(xyz_buf + i, &calibrated_mean);
-					calibrated = true; // done calibrating
-				}
-				continue;
-			}
+/*
+ * Is the LSM9DS0 simulated?
+ */
+#ifdef NO_MRAA
+static bool simulate = true;
+#else
+static bool simulate = false;
+#endif
+/*
+ * The first device's simulated LSM9DS0 and its virtual clock, or NULL on
+ * hardware
+ */
+static SimLSM9DS0 *sim;
+/*
+ * Seed for the simulated noise
+ */
+static int sim_seed = 1;
+/*
+ * Standard deviation of the simulated accelerometer noise (g), or negative
+ * for the simulator's default
+ */
+static float sim_noise = -1;
+/*
+ * Simulated temperature, its change per minute, and the accelerometer's offset
+ * per degree (g), or NAN for the simulator's default
+ */
+static float sim_temperature = NAN;
+static float sim_temperature_rate = 0;
+static float sim_temperature_coefficient = 0;
+/*
+ * Simulated I2C bus speed (Hz)
+ */
+static int sim_bus_hz = 100000;
+/*
+ * Simulated time after which to give up (ms), or 0 to run forever
+ */
+static int sim_duration_ms = 60000;
+/*
+ * A movement to inject into a simulated sensor
+ */
+struct sim_motion {
+	SimLSM9DS0::sensor sensor;
+	int device;
+	int64_t start_ms;
+	int64_t duration_ms;
+	float amplitude;
+	float frequency;
+	int axis;
+};
+/*
+ * Movements to inject into the simulated sensors
+ */
+static vector<struct sim_motion> sim_motions;
 
-			xyz_subtract(p, &calibrated_mean); // renormalize the point from the calibrated mean
+/*
+ * Should run statistics be printed on exit?
+ */
+static bool stats = false;
+/*
+ * Samples read
+ */
+static uint64_t stats_samples = 0;
+/*
+ * Times still went to sleep and woke up again
+ */
+static uint64_t stats_wakeups = 0;
+/*
+ * Detector updates, and the time spent in them (ns)
+ */
+static uint64_t stats_updates = 0;
+static int64_t stats_detector_ns = 0;
+/*
+ * Cost of reading the clock around each update (ns), subtracted from
+ * stats_detector_ns
+ */
+static int64_t stats_clock_ns;
 
-			// update current mean
-			xyz_mean(&current_mean, xyz_buf, xyz_buf_size);
-			// current mean distance from calibrated mean
-			float current_magnitude = xyz_magnitude(&current_mean);
+/*
+ * File to record samples to, or empty if they're not recorded
+ */
+static string record_file;
+/*
+ * Samples the recording's ring holds
+ */
+static int record_capacity = 1 << 20;
+/*
+ * The recording, or NULL
+ */
+static struct recorder *recorder;
 
-			// trigger if accelerometer coordinates changed enough, or if there was an overflow
-			if(current_magnitude > threshold * calibrated_magnitude || imu->xDataOverflow())
-				trigger();
-		} else if(calibrated) // if already calibrated
-			usleep(sample_delay_ms * 1000); // sleep 10ms
-	}
+/*
+ * Socket to stream samples on, or empty if they're not streamed
+ */
+static string stream_path;
+/*
+ * The stream, or NULL
+ */
+static struct streamer *streamer;
+/*
+ * Is still streaming without a command or rules to trigger?
+ */
+static bool stream_only = false;
 
-	return 0;
-}
+/*
+ * File to share the latest state through, or empty if it isn't shared
+ */
+static string shm_file;
+/*
+ * The shared state, or NULL
+ */
+static struct still_state *shared_state;
 
-static void parse_args(int argc, char **argv) { // parse args
-	vector<string> command;
+/*
+ * Recording to replay instead of sampling, or NULL
+ */
+static const struct record_header *replay_recording;
 
-	po::options_description visible;
-	po::options_description hidden;
-	po::options_description all;
+/*
+ * File to write the latency histograms to, or empty if they're not kept
+ */
+static string latency_file;
+/*
+ * Latency histograms, see --latency
+ */
+static struct histogram latency_read, latency_queue, latency_detect, latency_exec, latency_total;
+static struct histogram latency_interval, latency_jitter;
+/*
+ * Samples read late, and samples estimated missed from overflows
+ */
+static uint64_t late_samples = 0;
+static uint64_t missed_samples = 0;
+/*
+ * When the current batch was seen to be ready, finished reading and was
+ * taken off its bus's ring, and whose clock they're on
+ */
+static int64_t batch_ready_ns, batch_read_ns, batch_dequeued_ns;
+static struct device *batch_device;
+/*
+ * When the detector decided on the last sample, on batch_device's clock
+ */
+static int64_t decided_ns;
+/*
+ * Set by the SIGUSR1 handler, cleared when the main loop writes latency_file
+ */
+static volatile sig_atomic_t latency_dump_requested = 0;
 
-	string buffer_help =
-			(boost::format("sample buffer size (%1%)") % xyz_buf_size).str();
-	string calibration_help =
-			(boost::format("sample buffer initial discard ms (%1%)") % discard_time).str();
-	string threshold_help =
-			(boost::format("sample buffer deviation threshold (%1%)") % threshold).str();
-	string watchdog_help =
-			string("enable watchdog timer");
-	string watchdog_timeout_help =
-			(boost::format("specify watchdog timer timeout (%1%)") % watchdog_timeout).str();
-	string sample_delay_help =
-			(boost::format("sample delay ms (%1%)") % sample_delay_ms).str();
+/*
+ * Samples read by the last call to xyz_read_accel()
+ */
+static struct xyz_raw accel_batch[LSM9DS0::ACCEL_FIFO_DEPTH];
+/*
+ * Return a timestamp in milliseconds.  Returns zero from
+ * the first invocation, and the time since zero for all
+ * subsequent invocations.
+ */
+static int64_t timestamp_ms();
+/*
+ * Return the time in nanoseconds on CLOCK_MONOTONIC, or on the simulator's
+ * virtual clock
+ */
+static int64_t clock_ns();
+/*
+ * Sleep ms milliseconds, or let the simulator's virtual clock run for as long
+ */
+static void sleep_ms(int ms);
+/*
+ * Sleep ns nanoseconds, or let the simulator's virtual clock run for as long
+ */
+static void sleep_ns(int64_t ns);
+/*
+ * Return the time in nanoseconds on CLOCK_MONOTONIC, even when simulating
+ */
+static int64_t real_clock_ns();
 
+/*
+ * Read all available raw accelerometer samples of device d into the array
+ * starting with *p, oldest first, and set *overflow if the accelerometer
+ * dropped any samples.  Returns the number of samples read.
+ */
+static int xyz_read_accel(struct device *d, struct xyz_raw *p, bool *overflow);
+/*
+ * Convert the raw accelerometer sample *q of device d to g's in *p, returning p
+ */
+static struct xyz *xyz_from_raw(struct device *d, struct xyz *p, const struct xyz_raw *q);
+/*
+ * Main program entry
+ */
+int main(int argc, char **argv);
 
-	visible.add_options()
-			("help", "show this help")
-			("buffer", po::value<int>(), buffer_help.c_str())
-			("discard", po::value<int>(), calibration_help.c_str())
-			("threshold", po::value<float>(), threshold_help.c_str())
-			("watchdog", watchdog_help.c_str())
+/*
+ * Parse command-line arguments and set options
+ */
+static void parse_args(int argc, char **argv);
+/*
+ * Allocate device d's sample buffers and detector
+ */
+static void init_device(struct device *d);
+/*
+ * Create the simulated LSM9DS0s and inject the requested movements
+ */
+static void init_simulation();
+/*
+ * Return the executable execvp() would run for file, or NULL if there is none
+ */
+static char *resolve_command(const char *file);
+/*
+ * Pin still to realtime_cpu, lock and prefault its memory, and switch to
+ * SCHED_FIFO, as far as permissions allow
+ */
+static void init_realtime();
+/*
+ * Touch REALTIME_STACK_PREFAULT bytes of stack so the loop never faults on it
+ */
+static void prefault_stack();
+/*
+ * Order action rules most severe first
+ */
+static bool more_severe(const struct action_rule &a, const struct action_rule &b);
+/*
+ * Initializes the watchdog timer and starts the feeder thread
+ */
+static void init_watchdog();
+/*
+ * Feeder thread: every third of the timeout, keep the watchdog alive if every
+ * device's heartbeat has moved since the last time
+ */
+static void *feed_watchdog(void *arg);
+/*
+ * Stop the feeder thread, so watchdog_fd can be closed
+ */
+static void stop_watchdog();
+/*
+ * Publish that a batch of device d's samples made it through the detector
+ */
+static void heartbeat(struct device *d);
+/*
+ * Routes the accelerometer interrupt and installs the GPIO edge handler
+ */
+static void init_irq();
+#ifndef NO_MRAA
+/*
+ * Interrupt GPIO edge handler
+ */
+static void irq_handler(void *arg);
+#endif
+/*
+ * Route the signals still waits for to the interrupt pin, either data ready
+ * (or FIFO watermark) or, with hw set, the interrupt generators
+ */
+static void route_irq(bool hw);
+/*
+ * Block until the accelerometer interrupt fires or timeout_ms elapses
+ */
+static void wait_irq(int timeout_ms);
+/*
+ * Program the interrupt generators to detect the same movement as the software
+ * trigger, given the calibrated mean and its magnitude, and stop sampling
+ */
+static void arm_hw_detect(struct xyz *mean, float magnitude);
+/*
+ * Turn the interrupt generators off and resume sampling
+ */
+static void disarm_hw_detect();
+/*
+ * Wait up to hw_health_ms for the interrupt generators, publishing a heartbeat
+ * if the IMU still responds.  Returns true if a generator fired.
+ */
+static bool wait_hw_detect();
+/*
+ * Create the gyroscope and magnetometer channels that are turned on
+ */
+static void init_channels();
+/*
+ * Read the gyroscope and magnetometer if they're due, and react to their
+ * combined decision with the accelerometer's
+ */
+static void poll_channels();
+/*
+ * Combine the accelerometer's last decision with the channels'.  Returns
+ * true if the combination has moved.
+ */
+static bool combine_channels();
+/*
+ * Return how long to sleep, at most max_ns, before a channel is due
+ */
+static int64_t channel_sleep_ns(int64_t max_ns);
+/*
+ * React to a decision made at now_ns: with --keep-going, let the rules see
+ * deviation, raised to the threshold if moved or overflow, otherwise trigger
+ * if moved or overflow
+ */
+static void react(bool moved, bool overflow, float deviation, int64_t now_ns);
+/*
+ * Feed raw samples first to n-1 of r to device d's detector, a block at a
+ * time, or to its calibration until it has a full buffer.  For each sample
+ * the detector decided, sets moved[i] and, unless deviation is NULL,
+ * deviation[i], its deviation from the calibrated mean as a fraction of the
+ * calibrated magnitude.  Returns the index of the first decided sample, or
+ * n if there were none.
+ */
+static int detect_batch(struct device *d, const struct xyz_raw *r, int first, int n,
+		bool *moved, float *deviation);
+/*
+ * Add raw sample *r to device d's calibration, calibrating the detector
+ * once the buffer is full
+ */
+static void calibrate_sample(struct device *d, const struct xyz_raw *r);
+/*
+ * Feed k raw samples r, no more than the buffer or an xyz_block, to device
+ * d's calibrated detector, setting moved and deviation as detect_batch() does
+ */
+static void detect_block(struct device *d, const struct xyz_raw *r, int k,
+		bool *moved, float *deviation);
+/*
+ * Return device d's deviation from its calibrated mean at the last sample,
+ * as a fraction of the calibrated magnitude
+ */
+static float device_deviation(struct device *d);
+/*
+ * Follow raw sample *r, at deviation, with device d's baseline, and hand the
+ * tracked mean to its detector once per buffer
+ */
+static void track_baseline(struct device *d, const struct xyz_raw *r, float deviation);
+/*
+ * Read device d's temperature if it's due at now_ns, returning degrees C,
+ * or NAN if it isn't due
+ */
+static float device_temperature(struct device *d, int64_t now_ns);
+/*
+ * Sample every bus in its own thread and run their batches through the
+ * detectors and the trigger.  Never returns.
+ */
+static void watch_devices();
+/*
+ * Bus thread: sample the devices on the bus *arg into its ring
+ */
+static void *sample_bus(void *arg);
+/*
+ * Stop the bus threads, if they were started, so still can exit cleanly
+ */
+static void stop_buses();
+/*
+ * Start fn(arg) in *thread with SIGCHLD blocked, so only the thread that
+ * spawns actions ever handles it.  Returns pthread_create()'s result.
+ */
+static int start_thread(pthread_t *thread, void *(*fn)(void *), void *arg);
+/*
+ * Block SIGCHLD in the calling thread, saving its mask to *old, so any thread
+ * started until the mask is restored (ours, or one a library starts for us)
+ * inherits it blocked
+ */
+static void block_sigchld(sigset_t *old);
+/*
+ * Give up on a simulation that ran out of time
+ */
+static void sim_timeout();
+/*
+ * Trigger the command
+ */
+static void trigger();
+/*
+ * Measure the cost of timing a detector update
+ */
+static void init_stats();
+/*
+ * Print the run statistics, with result saying why still is exiting
+ */
+static void print_stats(const char *result);
+/*
+ * Return when sample i of a batch of n read at read_ns was taken, assuming
+ * the samples were one ODR period apart up to the read
+ */
+static int64_t sample_time(int64_t read_ns, int n, int i);
+/*
+ * Return how many samples of a batch of n read at read_ns were taken during
+ * the discard time
+ */
+static int discarded(int64_t read_ns, int n);
+/*
+ * Create the recording, starting at start_ns
+ */
+static void init_recording(int64_t start_ns);
+/*
+ * Record a batch of n samples p of device, read at read_ns, the first of which
+ * may have followed an overflow
+ */
+static void record_batch(int device, const struct xyz_raw *p, int n, bool overflow,
+		int64_t read_ns);
+/*
+ * Start listening for stream subscribers
+ */
+static void init_stream();
+/*
+ * Record and stream a batch of n samples p of device, read at read_ns, the
+ * first of which may have followed an overflow, wherever they're kept
+ */
+static void publish_batch(int device, const struct xyz_raw *p, int n, bool overflow,
+		int64_t read_ns);
+/*
+ * Create the shared state
+ */
+static void init_shared_state();
+/*
+ * Share device d's batch of n raw samples r, read at read_ns, in one write:
+ * deviation[i] for the samples from decided on, unless deviation is NULL
+ */
+static void share_batch(struct device *d, const struct xyz_raw *r, int n, int decided,
+		const float *deviation, bool overflow, int64_t read_ns);
+/*
+ * Run replay_recording through the detectors and print the trigger points.
+ * Never returns.
+ */
+static void replay();
+/*
+ * Install the SIGUSR1 handler that requests a latency dump
+ */
+static void init_latency();
+/*
+ * SIGUSR1 handler
+ */
+static void latency_signal(int sig);
+/*
+ * Account for a batch of n samples of device d that was seen ready at
+ * ready_ns, read at read_ns and taken off its bus's ring at dequeued_ns (or
+ * -1 if no ring was in between), and may have overflowed
+ */
+static void latency_batch(struct device *d, int64_t ready_ns, int64_t read_ns,
+		int64_t dequeued_ns, int n, bool overflow);
+/*
+ * Account for the detector's decisions on the current batch, which come
+ * all at once
+ */
+static void latency_decision();
+/*
+ * Return the time on the current batch's clock: its bus's virtual clock with
+ * --simulate
+ */
+static int64_t latency_clock_ns();
+/*
+ * Write the latency histograms and counters to latency_file
+ */
+static void dump_latency();
+
+int main(int argc, char** argv) {
+	// set options based on args
+	parse_args(argc, argv);
+
+	// coordinate buffers and detectors
+	for(size_t i = 0; i < devices.size(); i++)
+		init_device(&devices[i]);
+
+	if(replay_recording) // maybe work from a recording instead
+		replay();
+
+	if(realtime || realtime_cpu >= 0) // maybe lock down before anything else runs
+		init_realtime();
+
+	if(simulate) // maybe simulate the IMUs
+		init_simulation();
+
+	for(size_t i = 0; i < devices.size(); i++) {
+		struct device *d = &devices[i];
+		// access the IMU, or a simulation of it
+		if(d->sim)
+			d->imu = new LSM9DS0(d->sim->gyroBus(), d->sim->xmBus());
+#ifndef NO_MRAA
+		else
+			d->imu = new LSM9DS0(d->g_addr, d->xm_addr, d->bus);
+#endif
+		if(i2c_speed_hz && !d->imu->setBusSpeed(i2c_speed_hz)) { // before begin()'s writes
+			cerr << "unable to run I2C bus " << d->bus << " at " << i2c_speed_hz << " Hz\n";
+			exit(-1);
+		}
+
+		// bring up the accelerometer at --scale (IMU overflow will trigger the command),
+		// and the gyroscope and magnetometer only if they're watched
+		d->imu->begin(LSM9DS0::G_SCALE_245DPS, accel_scale, LSM9DS0::M_SCALE_2GS,
+				gyro_odr, accel_odr, mag_odr, (LSM9DS0::accel_abw) accel_abw,
+				LSM9DS0::INIT_ACCEL |
+				(gyro_threshold > 0 ? LSM9DS0::INIT_GYRO : 0) |
+				(mag_threshold > 0 || (track_tau_s > 0 && temperature_interval_ms) ?
+						LSM9DS0::INIT_MAG : 0)); // the temperature sensor is the magnetometer's
+
+		if(fifo) // maybe let the IMU buffer samples between reads
+			d->imu->enableAccelFIFO(LSM9DS0::FIFO_STREAM, fifo_watermark);
+		d->g_per_lsb = d->imu->calcAccel(1);
+	}
+	imu = devices[0].imu;
+	init_channels();
+
+	if(irq_gpio >= 0) // maybe wait for interrupts instead of polling
+		init_irq();
+
+	if(watchdog) // maybe initialize watchdog timer device
+		init_watchdog();
+
+	if(stats) // maybe measure the loop
+		init_stats();
+
+	if(!latency_file.empty()) // maybe time every stage
+		init_latency();
+
+	sampling_start_ns = clock_ns(); // the discard time starts now
+
+	if(!record_file.empty()) // maybe keep every sample
+		init_recording(sampling_start_ns);
+
+	if(!stream_path.empty()) // maybe share every sample
+		init_stream();
+
+	if(!shm_file.empty()) // maybe share the latest state
+		init_shared_state();
+
+	if(keep_going) // maybe run rules instead of exiting
+		action_init(&rules[0], rules.size());
+
+	// sample in acquisition threads, unless something needs the single loop
+	if(devices.size() > 1 || !(irq || hw_detect || gyro_channel || mag_channel))
+		watch_devices();
+
+	struct device *dev = &devices[0];
+	// are the interrupt generators watching instead of the software trigger?
+	bool hw_armed = false;
+	// samples left for the software trigger to confirm an interrupt generator event
+	int hw_confirm_samples = 0;
+
+	for(;;) {
+		if(latency_dump_requested) {
+			latency_dump_requested = 0;
+			dump_latency();
+		}
+
+		if(sim && sim_duration_ms && clock_ns() / 1000000 >= sim_duration_ms)
+			sim_timeout();
+
+		if(gyro_channel || mag_channel) // read the other sensors when they're due
+			poll_channels();
+
+		if(hw_armed) { // only wake up for the interrupt generators
+			if(!wait_hw_detect())
+				continue;
+			disarm_hw_detect();
+			hw_armed = false;
+			hw_confirm_samples = xyz_buf_size; // confirm over a full buffer of fresh samples
+		}
+
+		if(dev->baseline) { // maybe feed the temperature model
+			float celsius = device_temperature(dev, clock_ns());
+			if(!isnan(celsius))
+				dev->baseline->temperature(celsius);
+		}
+
+		bool overflow;
+		int64_t ready_ns = latency_file.empty() ? 0 : clock_ns();
+		int n = xyz_read_accel(dev, accel_batch, &overflow);
+		if(n > 0) {
+			stats_samples += n;
+			int64_t read_ns = clock_ns();
+			// record and stream even the samples about to be discarded
+			publish_batch(0, accel_batch, n, overflow, read_ns);
+
+			int first = discarded(read_ns, n); // discard early points for excessive noise
+			if(first == n) {
+				if(shared_state)
+					share_batch(dev, accel_batch, n, n, NULL, overflow, read_ns);
+				heartbeat(dev);
+				continue;
+			}
+
+			if(!latency_file.empty()) // no ring, so detection starts on the read
+				latency_batch(dev, ready_ns, read_ns, -1, n, overflow);
+
+			bool calibrating = !dev->calibrated;
+			bool batch_moved[LSM9DS0::ACCEL_FIFO_DEPTH];
+			float batch_deviation[LSM9DS0::ACCEL_FIFO_DEPTH];
+			int decided = detect_batch(dev, accel_batch, first, n, batch_moved,
+					keep_going || gyro_channel || mag_channel || shared_state ?
+							batch_deviation : NULL);
+			if(shared_state) // before any of its decisions can trigger
+				share_batch(dev, accel_batch, n, decided, batch_deviation, overflow, read_ns);
+			if(calibrating && dev->calibrated && hw_detect) { // hand off to the interrupt generators
+				arm_hw_detect(&dev->calibrated_mean, dev->calibrated_magnitude);
+				hw_armed = true;
+			}
+
+			for(int i = decided; i < n; i++) { // act on every sample the trigger decided
+				bool moved = batch_moved[i];
+				float deviation = 0;
+				if(keep_going || gyro_channel || mag_channel || shared_state)
+					deviation = batch_deviation[i];
+				if(gyro_channel || mag_channel) { // combine with the other sensors
+					accel_moved = moved;
+					accel_deviation = deviation;
+					moved = combine_channels();
+				}
+				// trigger if the coordinates changed enough, or if there was an overflow
+				react(moved, overflow, deviation, clock_ns());
+
+				// nothing confirmed, hand back to the interrupt generators
+				if(hw_detect && !hw_armed && --hw_confirm_samples <= 0) {
+					arm_hw_detect(&dev->calibrated_mean, dev->calibrated_magnitude);
+					hw_armed = true;
+				}
+			}
+			heartbeat(dev); // the batch made it through the detector
+		} else if(irq) // sleep until the accelerometer has data, or a channel is due
+			wait_irq((channel_sleep_ns(IRQ_TIMEOUT_MS * 1000000LL) + 999999) / 1000000);
+		else if(dev->calibrated || realtime) // if already calibrated, or spinning would starve the CPU
+			sleep_ns(channel_sleep_ns(sample_delay_ms * 1000000LL)); // sleep 10ms
+	}
+
+	return 0;
+}
+
+static void parse_args(int argc, char **argv) { // parse args
+	vector<string> command;
+
+	po::options_description visible;
+	po::options_description hidden;
+	po::options_description all;
+
+	string buffer_help =
+			(boost::format("sample buffer size (%1%)") % xyz_buf_size).str();
+	string calibration_help =
+			(boost::format("sample buffer initial discard ms (%1%)") % discard_time).str();
+	string threshold_help =
+			(boost::format("sample buffer deviation threshold (%1%)") % threshold).str();
+	string bands_help =
+			string("lo-hi[,lo-hi...] Hz bands for --detector band (20-200)");
+	string track_help =
+			string("baseline tracking time constant s, 0 for none (0)");
+	string track_quiet_help =
+			(boost::format("quiet deviation for tracking, fraction of threshold (%1%)")
+					% track_quiet).str();
+	string track_confirm_help =
+			(boost::format("quiet s before tracking (%1%)") % track_confirm_s).str();
+	string temperature_help =
+			(boost::format("temperature read ms while tracking, 0 for none (%1%)")
+					% temperature_interval_ms).str();
+	string keep_going_help =
+			string("keep sampling after movement, running commands without waiting");
+	string rule_help =
+			string("deviation[:cooldown[:debounce]]=command to run, implies --keep-going");
+	string cooldown_help =
+			(boost::format("default rule cooldown ms (%1%)") % rule_cooldown_ms).str();
+	string debounce_help =
+			(boost::format("default rule debounce samples (%1%)") % rule_debounce).str();
+	vector<string> rule_specs;
+	string device_help =
+			string("bus[:gyro_addr:xm_addr] of an LSM9DS0 to watch (1:0x6B:0x1D)");
+	vector<string> device_specs;
+	string realtime_help =
+			string("mlockall, prefault and run under SCHED_FIFO");
+	string realtime_priority_help =
+			(boost::format("SCHED_FIFO priority, implies --realtime (%1%)")
+					% realtime_priority).str();
+	string realtime_cpu_help =
+			string("CPU to pin still to");
+	string odr_help =
+			(boost::format("accelerometer output data rate Hz (%1%)")
+					% accel_odr_hz[accel_odr]).str();
+	string abw_help =
+			string("accelerometer anti-alias bandwidth Hz: 773, 362, 194 or 50 (half the ODR)");
+	string scale_help =
+			(boost::format("accelerometer full scale g: 2, 4, 6, 8 or 16 (%1%)")
+					% accel_scale_g[accel_scale]).str();
+	string i2c_speed_help =
+			string("I2C bus clock Hz: 100000 or 400000 (mraa's default)");
+	string gyro_help =
+			string("gyroscope threshold dps, turns the gyroscope on");
+	string gyro_odr_help =
+			(boost::format("gyroscope output data rate Hz (%1%)")
+					% gyro_odr_hz[gyro_odr / 4]).str();
+	string mag_help =
+			string("magnetometer threshold fraction, turns the magnetometer on");
+	string mag_odr_help =
+			(boost::format("magnetometer output data rate Hz (%1%)")
+					% mag_odr_hz[mag_odr]).str();
+	string combine_help =
+			string("combine sensors: any, all or weighted (any)");
+	string weights_help =
+			(boost::format("accel,gyro,mag weights for --combine weighted (%1%,%2%,%3%)")
+					% combine_weights[0] % combine_weights[1] % combine_weights[2]).str();
+	string detector_help =
+			(boost::format("detector: %1% (%2%)") % detector_names % detector_name).str();
+	string watchdog_help =
+			string("enable watchdog timer");
+	string watchdog_timeout_help =
+			(boost::format("specify watchdog timer timeout (%1%)") % watchdog_timeout).str();
+	string sample_delay_help =
+			(boost::format("sample delay ms (%1%)") % sample_delay_ms).str();
+	string fifo_help =
+			string("buffer samples in the accelerometer FIFO");
+	string fifo_watermark_help =
+			(boost::format("FIFO level to drain at, implies --fifo (1-%1%)")
+					% (LSM9DS0::ACCEL_FIFO_DEPTH - 1)).str();
+	string irq_gpio_help =
+			string("mraa GPIO pin wired to the accelerometer interrupt");
+	string hw_detect_help =
+			string("detect movement with the accelerometer interrupt generators");
+	string hw_hpf_help =
+			string("high-pass filter interrupt generator data");
+	string hw_duration_help =
+			(boost::format("interrupt generator duration samples (%1%)") % hw_duration).str();
+	string hw_health_help =
+			(boost::format("interrupt generator check interval ms (%1%)") % hw_health_ms).str();
+	string stats_help =
+			string("print run statistics as JSON on stderr when exiting");
+	string record_help =
+			string("record raw samples to a ring in file");
+	string record_size_help =
+			(boost::format("samples the recording holds (%1%)") % record_capacity).str();
+	string stream_help =
+			string("stream raw samples to subscribers on a Unix socket at path");
+	string shm_help =
+			string("share the latest state through a mapping of file, e.g. /dev/shm/still");
+	string replay_help =
+			string("run a --record file through the detectors and print trigger points");
+	string latency_help =
+			string("write stage latency histograms to file on SIGUSR1 and exit");
+	string simulate_help =
+			string("run against a simulated LSM9DS0 on a virtual clock");
+	string sim_seed_help =
+			(boost::format("simulated noise seed (%1%)") % sim_seed).str();
+	string sim_noise_help =
+			string("simulated accelerometer noise standard deviation g");
+	string sim_bus_help =
+			(boost::format("simulated I2C bus speed Hz (%1%)") % sim_bus_hz).str();
+	string sim_motion_help =
+			string("simulated movement [device/][sensor:]start:duration:amplitude[:frequency[:axis]]");
+	string sim_temperature_help =
+			string("simulated temperature celsius[:rate per minute[:coefficient g per degree]]");
+	string sim_duration_help =
+			(boost::format("simulated ms to give up after (%1%)") % sim_duration_ms).str();
+	vector<string> sim_motion_specs;
+
+
+	visible.add_options()
+			("help", "show this help")
+			("buffer", po::value<int>(), buffer_help.c_str())
+			("discard", po::value<int>(), calibration_help.c_str())
+			("threshold", po::value<float>(), threshold_help.c_str())
+			("detector", po::value<string>(), detector_help.c_str())
+			("bands", po::value<string>(), bands_help.c_str())
+			("track", po::value<float>(), track_help.c_str())
+			("track-quiet", po::value<float>(), track_quiet_help.c_str())
+			("track-confirm", po::value<float>(), track_confirm_help.c_str())
+			("temperature", po::value<int>(), temperature_help.c_str())
+			("keep-going", keep_going_help.c_str())
+			("rule", po::value(&rule_specs), rule_help.c_str())
+			("cooldown", po::value<int>(), cooldown_help.c_str())
+			("debounce", po::value<int>(), debounce_help.c_str())
+			("device", po::value(&device_specs), device_help.c_str())
+			("realtime", realtime_help.c_str())
+			("priority", po::value<int>(), realtime_priority_help.c_str())
+			("cpu", po::value<int>(), realtime_cpu_help.c_str())
+			("watchdog", watchdog_help.c_str())
 			("timeout", po::value<int>(), watchdog_timeout_help.c_str())
-			("delay", po::value<int>(), sample_delay_help.c_str());
+			("odr", po::value<float>(), odr_help.c_str())
+			("abw", po::value<float>(), abw_help.c_str())
+			("scale", po::value<float>(), scale_help.c_str())
+			("i2c-speed", po::value<int>(), i2c_speed_help.c_str())
+			("delay", po::value<int>(), sample_delay_help.c_str())
+			("gyro", po::value<float>(), gyro_help.c_str())
+			("gyro-odr", po::value<float>(), gyro_odr_help.c_str())
+			("mag", po::value<float>(), mag_help.c_str())
+			("mag-odr", po::value<float>(), mag_odr_help.c_str())
+			("combine", po::value<string>(), combine_help.c_str())
+			("weights", po::value<string>(), weights_help.c_str())
+			("fifo", fifo_help.c_str())
+			("watermark", po::value<int>(), fifo_watermark_help.c_str())
+			("irq-gpio", po::value<int>(), irq_gpio_help.c_str())
+			("hw-detect", hw_detect_help.c_str())
+			("hw-hpf", hw_hpf_help.c_str())
+			("hw-duration", po::value<int>(), hw_duration_help.c_str())
+			("health", po::value<int>(), hw_health_help.c_str())
+			("stats", stats_help.c_str())
+			("record", po::value<string>(), record_help.c_str())
+			("record-size", po::value<int>(), record_size_help.c_str())
+			("stream", po::value<string>(), stream_help.c_str())
+			("shm", po::value<string>(), shm_help.c_str())
+			("replay", po::value<string>(), replay_help.c_str())
+			("latency", po::value<string>(), latency_help.c_str())
+			("simulate", simulate_help.c_str())
+			("sim-seed", po::value<int>(), sim_seed_help.c_str())
+			("sim-noise", po::value<float>(), sim_noise_help.c_str())
+			("sim-bus", po::value<int>(), sim_bus_help.c_str())
+			("sim-motion", po::value(&sim_motion_specs), sim_motion_help.c_str())
+			("sim-temp", po::value<string>(), sim_temperature_help.c_str())
+			("sim-duration", po::value<int>(), sim_duration_help.c_str())
 			;
 	hidden.add_options()
 			("command", po::value(&command))
@@ -289,20 +1441,319 @@ static void parse_args(int argc, char **argv) { // parse args
 		cout << visible;
 		exit(unrecognized ? -1 : 0);
 	}
+	if(vm.count("replay")) { // the recording's settings, unless given here
+		string file = vm["replay"].as<string>();
+		if(!(replay_recording = record_open(file.c_str()))) {
+			cerr << "unable to replay " << file << ": " <<
+					(errno == EINVAL ? "not a recording" : strerror(errno)) << "\n";
+			exit(-1);
+		}
+		xyz_buf_size = replay_recording->buffer;
+		threshold = replay_recording->threshold;
+		discard_time = replay_recording->discard_ms;
+		if(replay_recording->detector[0])
+			detector_name = string(replay_recording->detector,
+					strnlen(replay_recording->detector, sizeof(replay_recording->detector)));
+		for(int odr = LSM9DS0::A_ODR_3125; odr <= LSM9DS0::A_ODR_1600; odr++)
+			if(fabs(accel_odr_hz[odr] - replay_recording->odr_hz) < 0.01)
+				accel_odr = (LSM9DS0::accel_odr) odr;
+	}
 	if(vm.count("buffer"))
 		xyz_buf_size = vm["buffer"].as<int>();
 	if(vm.count("discard"))
 		discard_time = vm["discard"].as<int>();
 	if(vm.count("threshold"))
 		threshold = vm["threshold"].as<float>();
+	if(vm.count("detector"))
+		detector_name = vm["detector"].as<string>();
+	if(vm.count("track"))
+		track_tau_s = vm["track"].as<float>();
+	if(vm.count("track-quiet"))
+		track_quiet = vm["track-quiet"].as<float>();
+	if(vm.count("track-confirm"))
+		track_confirm_s = vm["track-confirm"].as<float>();
+	if(vm.count("temperature"))
+		temperature_interval_ms = vm["temperature"].as<int>();
+	if(track_tau_s < 0 || track_quiet <= 0 || track_quiet > 1 || track_confirm_s < 0 ||
+			temperature_interval_ms < 0) {
+		cerr << "--track, --track-confirm and --temperature can't be negative, " <<
+				"and --track-quiet must be above 0 and at most 1\n";
+		exit(-1);
+	}
+	Detector *detector = make_detector(detector_name);
+	RawDetector *raw_detector = detector ? NULL : make_raw_detector(detector_name);
+	if(!detector && !raw_detector && detector_name != "band") {
+		cerr << "unknown detector " << detector_name << ", try one of " << detector_names << "\n";
+		exit(-1);
+	}
+	if(raw_detector && xyz_buf_size > RAW_DETECTOR_MAX_WINDOW) {
+		cerr << "detector " << detector_name << " supports a buffer of at most " <<
+				RAW_DETECTOR_MAX_WINDOW << "\n";
+		exit(-1);
+	}
+	delete detector; // every device makes its own
+	delete raw_detector;
+	if(device_specs.empty())
+		device_specs.push_back("1");
+	for(size_t i = 0; i < device_specs.size(); i++) {
+		struct device d;
+		memset(&d, 0, sizeof(d));
+		unsigned int g_addr = 0x6B, xm_addr = 0x1D;
+		int fields = sscanf(device_specs[i].c_str(), "%d:%i:%i", &d.bus, &g_addr, &xm_addr);
+		if((fields != 1 && fields != 3) || g_addr > 0x7F || xm_addr > 0x7F) {
+			cerr << "bad --device " << device_specs[i] << ", expected bus[:gyro_addr:xm_addr]\n";
+			exit(-1);
+		}
+		d.g_addr = g_addr;
+		d.xm_addr = xm_addr;
+		for(size_t j = 0; j < devices.size(); j++)
+			if(devices[j].bus == d.bus &&
+					(devices[j].g_addr == d.g_addr || devices[j].xm_addr == d.xm_addr)) {
+				cerr << "--device " << device_specs[i] << " is already watched\n";
+				exit(-1);
+			}
+		devices.push_back(d);
+	}
+	if(vm.count("realtime"))
+		realtime = true;
+	if(vm.count("priority")) {
+		realtime = true;
+		realtime_priority = vm["priority"].as<int>();
+		if(realtime_priority < sched_get_priority_min(SCHED_FIFO) ||
+				realtime_priority > sched_get_priority_max(SCHED_FIFO)) {
+			cerr << "priority must be between " << sched_get_priority_min(SCHED_FIFO) <<
+					" and " << sched_get_priority_max(SCHED_FIFO) << "\n";
+			exit(-1);
+		}
+	}
+	if(vm.count("cpu"))
+		realtime_cpu = vm["cpu"].as<int>();
 	if(vm.count("watchdog"))
 		watchdog = true;
 	if(vm.count("timeout")) {
 		watchdog = true;
-		watchdog_timeout_help = vm["timeout"].as<int>();
+		watchdog_timeout = vm["timeout"].as<int>();
+	}
+	if(vm.count("odr")) {
+		float hz = vm["odr"].as<float>();
+		int odr = LSM9DS0::A_ODR_3125;
+		while(odr <= LSM9DS0::A_ODR_1600 && fabs(accel_odr_hz[odr] - hz) > 0.01)
+			odr++;
+		if(odr > LSM9DS0::A_ODR_1600) {
+			cerr << "unsupported ODR " << hz << ", try 3.125, 6.25, 12.5, 25, 50, " <<
+					"100, 200, 400, 800 or 1600\n";
+			exit(-1);
+		}
+		accel_odr = (LSM9DS0::accel_odr) odr;
+	}
+	if(vm.count("abw")) {
+		float hz = vm["abw"].as<float>();
+		accel_abw = LSM9DS0::A_ABW_773;
+		while(accel_abw <= LSM9DS0::A_ABW_50 && fabs(accel_abw_hz[accel_abw] - hz) > 0.01)
+			accel_abw++;
+		if(accel_abw > LSM9DS0::A_ABW_50) {
+			cerr << "unsupported anti-alias bandwidth " << hz << ", try 773, 362, 194 or 50\n";
+			exit(-1);
+		}
+	} else { // let through as much as the ODR can represent
+		accel_abw = LSM9DS0::A_ABW_50;
+		for(int abw = LSM9DS0::A_ABW_773; abw <= LSM9DS0::A_ABW_50; abw++)
+			if(accel_abw_hz[abw] <= accel_odr_hz[accel_odr] / 2 &&
+					accel_abw_hz[abw] > accel_abw_hz[accel_abw])
+				accel_abw = abw;
+	}
+	if(vm.count("scale")) {
+		float g = vm["scale"].as<float>();
+		int scale = LSM9DS0::A_SCALE_2G;
+		while(scale <= LSM9DS0::A_SCALE_16G && fabs(accel_scale_g[scale] - g) > 0.01)
+			scale++;
+		if(scale > LSM9DS0::A_SCALE_16G) {
+			cerr << "unsupported full scale " << g << ", try 2, 4, 6, 8 or 16\n";
+			exit(-1);
+		}
+		accel_scale = (LSM9DS0::accel_scale) scale;
+	}
+	if(vm.count("i2c-speed")) {
+		i2c_speed_hz = vm["i2c-speed"].as<int>();
+		if(i2c_speed_hz != 100000 && i2c_speed_hz != 400000) {
+			cerr << "unsupported I2C bus speed " << i2c_speed_hz <<
+					", try 100000 (standard mode) or 400000 (fast mode)\n";
+			exit(-1);
+		}
+	}
+	string band_specs = "20-200";
+	if(vm.count("bands"))
+		band_specs = vm["bands"].as<string>();
+	else if(replay_recording && replay_recording->bands) { // as recorded
+		band_specs.clear();
+		for(uint32_t i = 0; i < replay_recording->bands && i < RECORD_MAX_BANDS; i++)
+			band_specs += (boost::format("%1%%2%-%3%") % (i ? "," : "") %
+					replay_recording->band[i].low_hz % replay_recording->band[i].high_hz).str();
+	}
+	for(size_t start = 0; start <= band_specs.size(); ) {
+		size_t end = band_specs.find(',', start);
+		if(end == string::npos)
+			end = band_specs.size();
+		string spec = band_specs.substr(start, end - start);
+		struct band b;
+		char extra;
+		if(sscanf(spec.c_str(), "%f-%f%c", &b.low_hz, &b.high_hz, &extra) != 2 ||
+				b.low_hz < 0 || b.high_hz < b.low_hz) {
+			cerr << "bad band " << spec << ", expected lo-hi in Hz\n";
+			exit(-1);
+		}
+		if(detector_name == "band" && !band_bins(&b, xyz_buf_size, accel_odr_hz[accel_odr])) {
+			cerr << "band " << spec << " has no DFT bin with a buffer of " << xyz_buf_size <<
+					" at " << accel_odr_hz[accel_odr] << " Hz, which resolves " <<
+					accel_odr_hz[accel_odr] / xyz_buf_size << " Hz up to " <<
+					accel_odr_hz[accel_odr] / 2 << " Hz\n";
+			exit(-1);
+		}
+		bands.push_back(b);
+		start = end + 1;
+	}
+	if(bands.size() > BAND_DETECTOR_MAX_BINS) {
+		cerr << "at most " << BAND_DETECTOR_MAX_BINS << " bands\n";
+		exit(-1);
 	}
 	if(vm.count("delay"))
 		sample_delay_ms = vm["delay"].as<int>();
+	if(vm.count("gyro"))
+		gyro_threshold = vm["gyro"].as<float>();
+	if(vm.count("gyro-odr")) {
+		float hz = vm["gyro-odr"].as<float>();
+		int odr = 0;
+		while(odr < 4 && fabs(gyro_odr_hz[odr] - hz) > 0.01)
+			odr++;
+		if(odr == 4) {
+			cerr << "unsupported gyroscope ODR " << hz << ", try 95, 190, 380 or 760\n";
+			exit(-1);
+		}
+		gyro_odr = (LSM9DS0::gyro_odr) (odr * 4);
+	}
+	if(vm.count("mag"))
+		mag_threshold = vm["mag"].as<float>();
+	if(vm.count("mag-odr")) {
+		float hz = vm["mag-odr"].as<float>();
+		int odr = LSM9DS0::M_ODR_3125;
+		while(odr <= LSM9DS0::M_ODR_100 && fabs(mag_odr_hz[odr] - hz) > 0.01)
+			odr++;
+		if(odr > LSM9DS0::M_ODR_100) {
+			cerr << "unsupported magnetometer ODR " << hz << ", try 3.125, 6.25, " <<
+					"12.5, 25, 50 or 100\n";
+			exit(-1);
+		}
+		mag_odr = (LSM9DS0::mag_odr) odr;
+	}
+	if(vm.count("combine")) {
+		string c = vm["combine"].as<string>();
+		if(c == "any")
+			combine = COMBINE_ANY;
+		else if(c == "all")
+			combine = COMBINE_ALL;
+		else if(c == "weighted")
+			combine = COMBINE_WEIGHTED;
+		else {
+			cerr << "unknown --combine " << c << ", try any, all or weighted\n";
+			exit(-1);
+		}
+	}
+	if(vm.count("weights") &&
+			sscanf(vm["weights"].as<string>().c_str(), "%f,%f,%f", combine_weights,
+					combine_weights + 1, combine_weights + 2) != 3) {
+		cerr << "bad --weights " << vm["weights"].as<string>() << ", expected a,g,m\n";
+		exit(-1);
+	}
+	if(vm.count("fifo"))
+		fifo = true;
+	if(vm.count("watermark")) {
+		fifo = true;
+		fifo_watermark = vm["watermark"].as<int>();
+		if(fifo_watermark < 1 || fifo_watermark >= LSM9DS0::ACCEL_FIFO_DEPTH) {
+			cerr << "watermark must be between 1 and " <<
+					LSM9DS0::ACCEL_FIFO_DEPTH - 1 << "\n";
+			exit(-1);
+		}
+	}
+
+	if(vm.count("irq-gpio"))
+		irq_gpio = vm["irq-gpio"].as<int>();
+	if(vm.count("hw-detect"))
+		hw_detect = true;
+	if(vm.count("hw-hpf"))
+		hw_hpf = true;
+	if(vm.count("hw-duration"))
+		hw_duration = vm["hw-duration"].as<int>();
+	if(vm.count("health"))
+		hw_health_ms = vm["health"].as<int>();
+	if(vm.count("stats"))
+		stats = true;
+	if(vm.count("record"))
+		record_file = vm["record"].as<string>();
+	if(vm.count("record-size")) {
+		record_capacity = vm["record-size"].as<int>();
+		if(record_capacity < 1) {
+			cerr << "record size must be at least 1\n";
+			exit(-1);
+		}
+	}
+	if(vm.count("stream"))
+		stream_path = vm["stream"].as<string>();
+	if(vm.count("shm"))
+		shm_file = vm["shm"].as<string>();
+	if(vm.count("latency"))
+		latency_file = vm["latency"].as<string>();
+	if(vm.count("simulate"))
+		simulate = true;
+	if(vm.count("sim-seed"))
+		sim_seed = vm["sim-seed"].as<int>();
+	if(vm.count("sim-noise"))
+		sim_noise = vm["sim-noise"].as<float>();
+	if(vm.count("sim-bus"))
+		sim_bus_hz = vm["sim-bus"].as<int>();
+	if(vm.count("sim-temp")) {
+		string spec = vm["sim-temp"].as<string>();
+		if(sscanf(spec.c_str(), "%f:%f:%f", &sim_temperature, &sim_temperature_rate,
+				&sim_temperature_coefficient) < 1) {
+			cerr << "bad --sim-temp " << spec << ", expected celsius[:rate[:coefficient]]\n";
+			exit(-1);
+		}
+	}
+	if(vm.count("sim-duration"))
+		sim_duration_ms = vm["sim-duration"].as<int>();
+	for(size_t i = 0; i < sim_motion_specs.size(); i++) {
+		struct sim_motion m;
+		double start, duration;
+		char axis = 'x';
+		m.frequency = 0;
+		const char *spec = sim_motion_specs[i].c_str();
+		m.device = 0;
+		const char *slash = strchr(spec, '/');
+		if(slash) {
+			m.device = atoi(spec);
+			spec = slash + 1;
+		}
+		m.sensor = SimLSM9DS0::ACCEL;
+		if(!strncmp(spec, "gyro:", 5)) {
+			m.sensor = SimLSM9DS0::GYRO;
+			spec += 5;
+		} else if(!strncmp(spec, "mag:", 4)) {
+			m.sensor = SimLSM9DS0::MAG;
+			spec += 4;
+		}
+		int fields = sscanf(spec, "%lf:%lf:%f:%f:%c",
+				&start, &duration, &m.amplitude, &m.frequency, &axis);
+		if(fields < 3 || axis < 'x' || axis > 'z' ||
+				m.device < 0 || m.device >= (int) devices.size()) {
+			cerr << "bad --sim-motion " << sim_motion_specs[i] <<
+					", expected [device/][sensor:]start:duration:amplitude[:frequency[:axis]]\n";
+			exit(-1);
+		}
+		m.start_ms = start;
+		m.duration_ms = duration;
+		m.axis = axis - 'x';
+		sim_motions.push_back(m);
+	}
 
 	if(command.size() == 0)
 		trigger_command = NULL;
@@ -315,11 +1766,207 @@ static void parse_args(int argc, char **argv) { // parse args
 			cc++;
 		}
 		*cc = NULL;
+		if(!(trigger_path = resolve_command(*trigger_command))) {
+			cerr << *trigger_command << ": command not found\n";
+			exit(-1);
+		}
+	}
+
+	if(vm.count("keep-going"))
+		keep_going = true;
+	if(vm.count("cooldown"))
+		rule_cooldown_ms = vm["cooldown"].as<int>();
+	if(vm.count("debounce"))
+		rule_debounce = vm["debounce"].as<int>();
+	for(size_t i = 0; i < rule_specs.size(); i++) {
+		keep_going = true;
+		struct action_rule r;
+		memset(&r, 0, sizeof(r));
+		r.cooldown_ms = rule_cooldown_ms;
+		r.debounce = rule_debounce;
+		size_t eq = rule_specs[i].find('=');
+		if(eq == string::npos || eq + 1 == rule_specs[i].size() ||
+				sscanf(rule_specs[i].substr(0, eq).c_str(), "%f:%d:%d",
+						&r.min, &r.cooldown_ms, &r.debounce) < 1) {
+			cerr << "bad --rule " << rule_specs[i] <<
+					", expected deviation[:cooldown[:debounce]]=command\n";
+			exit(-1);
+		}
+		r.path = (char *) "/bin/sh";
+		r.argv = (char **) malloc(4 * sizeof(char *));
+		r.argv[0] = (char *) "/bin/sh";
+		r.argv[1] = (char *) "-c";
+		r.argv[2] = strdup(rule_specs[i].c_str() + eq + 1);
+		r.argv[3] = NULL;
+		rules.push_back(r);
+	}
+	if(keep_going && trigger_command) { // the command is the rule at the threshold
+		struct action_rule r;
+		memset(&r, 0, sizeof(r));
+		r.min = threshold;
+		r.cooldown_ms = rule_cooldown_ms;
+		r.debounce = rule_debounce;
+		r.path = trigger_path;
+		r.argv = trigger_command;
+		rules.push_back(r);
+	}
+	if(keep_going && rules.empty() && !replay_recording) {
+		cerr << "--keep-going needs a command or a --rule\n";
+		exit(-1);
+	}
+	stream_only = !stream_path.empty() && !trigger_command && !keep_going;
+	sort(rules.begin(), rules.end(), more_severe);
+
+	if(devices.size() > 1 && (irq_gpio >= 0 || hw_detect || gyro_threshold > 0 ||
+			mag_threshold > 0)) {
+		cerr << "--irq-gpio, --hw-detect, --gyro and --mag only support one --device\n";
+		exit(-1);
+	}
+
+	// keep up with the ODR when polling: read the FIFO instead of the output registers
+	// once a --delay could miss samples, and poll it before it can fill up
+	float odr_hz = accel_odr_hz[accel_odr];
+	if(!replay_recording && irq_gpio < 0) {
+		if(!fifo && sample_delay_ms * odr_hz > 500) // sleeping over half a sample period
+			fifo = true;
+		int room = LSM9DS0::ACCEL_FIFO_DEPTH - fifo_watermark; // samples a sleep can add
+		int longest_ms = (int) (room * 1000 / odr_hz) - 1;
+		if(fifo && !vm.count("delay")) // leave half the room for the drain itself
+			sample_delay_ms = max(1, min(sample_delay_ms, (int) (room * 500 / odr_hz)));
+		else if(fifo && sample_delay_ms > longest_ms) {
+			cerr << "--delay " << sample_delay_ms << " overflows the FIFO at " << odr_hz <<
+					" Hz, try " << max(longest_ms, 0) << " or less" <<
+					(fifo_watermark ? " or a lower --watermark\n" : "\n");
+			exit(-1);
+		}
+	}
+	// the feeder wants a new heartbeat every third of the timeout, and a device
+	// only beats once per batch (or per health check while the generators wait)
+	if(watchdog && !replay_recording) {
+		int batch_ms = (int) ceil(max(fifo_watermark, 1) * 1000 / odr_hz) +
+				(irq_gpio < 0 ? sample_delay_ms : 0);
+		int longest_ms = hw_detect ? max(batch_ms, hw_health_ms) : batch_ms;
+		if(longest_ms * 3 >= watchdog_timeout * 1000) {
+			cerr << "a heartbeat can take " << longest_ms << "ms, too long to feed a " <<
+					watchdog_timeout << "s watchdog, try a --timeout over " <<
+					longest_ms * 3 / 1000 << (longest_ms > batch_ms ? " or a shorter --health\n" :
+							fifo_watermark ? ", a lower --watermark or a higher --odr\n" :
+							" or a higher --odr\n");
+			exit(-1);
+		}
+	}
+	// and make sure each bus can carry its devices' samples, when its speed is known
+	int bus_hz = simulate ? (i2c_speed_hz ? i2c_speed_hz : sim_bus_hz) : i2c_speed_hz;
+	for(size_t i = 0; !replay_recording && bus_hz > 0 && i < devices.size(); i++) {
+		int sharing = 0;
+		for(size_t j = 0; j < devices.size(); j++)
+			if(devices[j].bus == devices[i].bus)
+				sharing++;
+		// 9 bits per byte: FIFO bursts are 6 bytes a sample, polls 7 plus the addresses
+		float bits_per_s = sharing * odr_hz * 9 * (fifo ? 6 : 7 + 3);
+		if(bits_per_s > bus_hz) {
+			cerr << sharing << " accelerometer(s) at " << odr_hz << " Hz need about " <<
+					(int) bits_per_s << " Hz of I2C bus " << devices[i].bus << ", which runs at " <<
+					bus_hz << " Hz: try --i2c-speed 400000 or a lower --odr\n";
+			exit(-1);
+		}
+	}
+}
+
+static void init_device(struct device *d) { // buffers and detector
+	d->last_ready_ns = -1; // no batch yet
+	d->xyz_buf = (struct xyz *) malloc(xyz_buf_size * sizeof(struct xyz));
+	d->raw_buf = (struct xyz_raw *) malloc(xyz_buf_size * sizeof(struct xyz_raw));
+	if(detector_name == "band") // the only detector that needs more than its name
+		d->detector = make_band_detector(&bands[0], bands.size(), accel_odr_hz[accel_odr]);
+	else if(!(d->detector = make_detector(detector_name))) // parse_args() checked the name
+		d->raw_detector = make_raw_detector(detector_name);
+}
+
+static void init_simulation() { // set up the simulated IMUs
+	for(size_t i = 0; i < devices.size(); i++) {
+		SimLSM9DS0 *peer = NULL; // the first device on the same bus keeps its time
+		for(size_t j = 0; j < i && !peer; j++)
+			if(devices[j].bus == devices[i].bus)
+				peer = devices[j].sim;
+		SimLSM9DS0 *s = devices[i].sim = new SimLSM9DS0(sim_seed + i, peer);
+		s->setBusSpeed(sim_bus_hz);
+		if(sim_noise >= 0)
+			s->setNoise(SimLSM9DS0::ACCEL, sim_noise);
+		if(!isnan(sim_temperature)) {
+			s->setTemperature(sim_temperature);
+			s->setTemperatureRate(sim_temperature_rate / 60);
+			s->setTemperatureCoefficient(SimLSM9DS0::ACCEL, sim_temperature_coefficient,
+					sim_temperature_coefficient, sim_temperature_coefficient);
+		}
+	}
+	sim = devices[0].sim;
+	for(size_t i = 0; i < sim_motions.size(); i++) {
+		struct sim_motion *m = &sim_motions[i];
+		devices[m->device].sim->addMotion(m->sensor, m->axis, m->start_ms * 1000000,
+				m->duration_ms * 1000000, m->amplitude, m->frequency);
 	}
 }
 
+static char *resolve_command(const char *file) { // search PATH like execvp
+	struct stat st;
+	if(strchr(file, '/'))
+		return access(file, X_OK) == 0 ? strdup(file) : NULL;
+	const char *path = getenv("PATH");
+	if(!path)
+		path = "/bin:/usr/bin";
+	for(;;) {
+		const char *end = strchr(path, ':');
+		string dir(path, end ? end - path : strlen(path));
+		string candidate = (dir.empty() ? string(".") : dir) + "/" + file;
+		if(access(candidate.c_str(), X_OK) == 0 &&
+				stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+			return strdup(candidate.c_str());
+		if(!end)
+			return NULL;
+		path = end + 1;
+	}
+}
+
+static void init_realtime() { // lock down memory and scheduling
+	if(realtime_cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(realtime_cpu, &cpus);
+		if(sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+			cerr << "unable to pin to CPU " << realtime_cpu << ": " << strerror(errno) << "\n";
+	}
+	if(!realtime)
+		return;
+
+	if(mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		cerr << "unable to lock memory: " << strerror(errno) << "\n";
+	prefault_stack();
+	for(size_t i = 0; i < devices.size(); i++) {
+		memset(devices[i].xyz_buf, 0, xyz_buf_size * sizeof(struct xyz));
+		memset(devices[i].raw_buf, 0, xyz_buf_size * sizeof(struct xyz_raw));
+	}
+
+	// commands started by rules shouldn't inherit real-time priority
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = realtime_priority;
+	if(sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) < 0)
+		cerr << "unable to switch to SCHED_FIFO: " << strerror(errno) << "\n";
+}
+
+static void prefault_stack() { // fault in the stack below the caller
+	volatile char stack[REALTIME_STACK_PREFAULT];
+	for(size_t i = 0; i < sizeof(stack); i += 256)
+		stack[i] = 0;
+}
+
+static bool more_severe(const struct action_rule &a, const struct action_rule &b) {
+	return a.min > b.min;
+}
+
 static void init_watchdog() { // set up watchdog timer device
-	watchdog_fd = open(WATCHDOG_DEV, O_WRONLY);
+	watchdog_fd = open(WATCHDOG_DEV, O_WRONLY | O_CLOEXEC); // commands mustn't inherit it
 	if(watchdog_fd >= 0) {
 		int options = WDIOS_ENABLECARD;
 		ioctl(watchdog_fd, WDIOC_SETOPTIONS, &options);
@@ -334,66 +1981,655 @@ static void init_watchdog() { // set up watchdog timer device
 		watchdog_timeout = timeout;
 
 		ioctl(watchdog_fd, WDIOC_KEEPALIVE, 0);
+		if(start_thread(&watchdog_thread, feed_watchdog, NULL) != 0) {
+			cerr << "unable to start the watchdog feeder\n";
+			exit(-1);
+		}
 	} else {
 		cerr << "unable to open " WATCHDOG_DEV ", disabling watchdog support\n";
 		watchdog = false;
 	}
 }
 
-static void trigger() { // trigger the command
-	if(watchdog) // close the watchdog timer device so execvp'd command can't write to it
-		close(watchdog_fd);
-	if(!trigger_command)
+static void *feed_watchdog(void *arg) { // feed while the heartbeats move
+	vector<uint32_t> last(devices.size());
+	for(size_t i = 0; i < devices.size(); i++)
+		last[i] = __sync_fetch_and_add(&devices[i].heartbeat, 0);
+	bool stalled = false;
+
+	pthread_mutex_lock(&watchdog_lock);
+	while(!watchdog_stopping) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		int64_t ns = deadline.tv_nsec + watchdog_timeout * 1000000000LL / 3;
+		deadline.tv_sec += ns / 1000000000;
+		deadline.tv_nsec = ns % 1000000000;
+		while(!watchdog_stopping &&
+				pthread_cond_timedwait(&watchdog_wake, &watchdog_lock, &deadline) != ETIMEDOUT)
+			;
+		if(watchdog_stopping)
+			break;
+
+		bool alive = true; // every device must have moved on
+		for(size_t i = 0; i < devices.size(); i++) {
+			uint32_t beat = __sync_fetch_and_add(&devices[i].heartbeat, 0);
+			if(beat == last[i])
+				alive = false;
+			last[i] = beat;
+		}
+		if(alive) {
+			ioctl(watchdog_fd, WDIOC_KEEPALIVE, 0);
+			watchdog_feeds++;
+		} else if(!stalled) // let it expire, and say why once
+			cerr << "sampling stalled, no longer feeding the watchdog\n";
+		stalled = !alive;
+	}
+	pthread_mutex_unlock(&watchdog_lock);
+	return NULL;
+}
+
+static void stop_watchdog() { // wake the feeder up and wait for it
+	pthread_mutex_lock(&watchdog_lock);
+	watchdog_stopping = true;
+	pthread_cond_signal(&watchdog_wake);
+	pthread_mutex_unlock(&watchdog_lock);
+	pthread_join(watchdog_thread, NULL);
+}
+
+static void heartbeat(struct device *d) { // one atomic add, no syscall
+	__sync_fetch_and_add(&d->heartbeat, 1);
+}
+
+static void init_irq() { // set up interrupt GPIO
+	route_irq(false);
+
+	if(sim) { // the simulator's pins need no handler
+		irq = true;
+		return;
+	}
+
+#ifndef NO_MRAA
+	sem_init(&irq_sem, 0, 0);
+	irq_pin = new mraa::Gpio(irq_gpio);
+	irq_pin->dir(mraa::DIR_IN);
+	sigset_t old;
+	block_sigchld(&old); // mraa's interrupt thread mustn't reap actions' children
+	bool watching = irq_pin->isr(mraa::EDGE_RISING, irq_handler, NULL) == mraa::SUCCESS;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if(!watching) {
+		cerr << "unable to watch GPIO " << irq_gpio << ", polling instead\n";
+		delete irq_pin;
+		irq_pin = NULL;
+	} else
+		irq = true;
+#endif
+}
+
+#ifndef NO_MRAA
+static void irq_handler(void *arg) { // called from mraa's interrupt thread
+	sem_post(&irq_sem);
+}
+#endif
+
+static void route_irq(bool hw) { // choose interrupt pin signals
+	// with a watermark, the GPIO is wired to INT2_XM, otherwise to INT1_XM
+	if(fifo_watermark) {
+		if(hw)
+			imu->setInt2XMSources(LSM9DS0::INT2_XM_INTGEN1 | LSM9DS0::INT2_XM_INTGEN2);
+		else // interrupt when a batch is ready (or was lost)
+			imu->setInt2XMSources(LSM9DS0::INT2_XM_WTM | LSM9DS0::INT2_XM_OVERRUN);
+	} else {
+		if(hw)
+			imu->setInt1XMSources(LSM9DS0::INT1_XM_INTGEN1 | LSM9DS0::INT1_XM_INTGEN2);
+		else // initAccel()'s data ready signal
+			imu->setInt1XMSources(LSM9DS0::INT1_XM_DRDYA);
+	}
+}
+
+static void wait_irq(int timeout_ms) { // wait for interrupt GPIO edge
+	stats_wakeups++;
+	if(sim) { // route_irq() picked the pin
+		sim->waitInterrupt(fifo_watermark ? SimLSM9DS0::INT2_XM : SimLSM9DS0::INT1_XM,
+				timeout_ms * 1000000LL);
+		return;
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += timeout_ms * 1000000L;
+	deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+	deadline.tv_nsec %= 1000000000L;
+	while(sem_timedwait(&irq_sem, &deadline) < 0 && errno == EINTR)
+		;
+	while(sem_trywait(&irq_sem) == 0) // coalesce edges that piled up
+		;
+}
+
+static void arm_hw_detect(struct xyz *mean, float magnitude) { // hand off to the IMU
+	float deviation = threshold * magnitude; // same trigger distance as software
+	int duration = hw_duration;
+	if(hw_hpf) {
+		// the filter removes the calibrated mean, so any axis moving by the
+		// deviation is an event
+		imu->setAccelIntGenHPF(true, false);
+		imu->configAccelIntGen1(
+				LSM9DS0::INT_GEN_XHIE | LSM9DS0::INT_GEN_YHIE | LSM9DS0::INT_GEN_ZHIE,
+				imu->calcAccelIntGenThreshold(deviation), duration);
+		imu->configAccelIntGen2(0, 0, 0);
+	} else {
+		// the generators see gravity, so fire if any axis rises past the
+		// largest calibrated axis, or if that axis falls away (tilting)
+		float ax = fabs(mean->x), ay = fabs(mean->y), az = fabs(mean->z);
+		float top = ax;
+		uint8_t top_low = LSM9DS0::INT_GEN_XLIE;
+		if(ay > top) {
+			top = ay;
+			top_low = LSM9DS0::INT_GEN_YLIE;
+		}
+		if(az > top) {
+			top = az;
+			top_low = LSM9DS0::INT_GEN_ZLIE;
+		}
+		imu->setAccelIntGenHPF(false, false);
+		imu->configAccelIntGen1(
+				LSM9DS0::INT_GEN_XHIE | LSM9DS0::INT_GEN_YHIE | LSM9DS0::INT_GEN_ZHIE,
+				imu->calcAccelIntGenThreshold(top + deviation), duration);
+		imu->configAccelIntGen2(top_low,
+				imu->calcAccelIntGenThreshold(top - deviation), duration);
+	}
+	imu->latchAccelIntGen(true, true); // hold events until wait_hw_detect() reads them
+
+	if(fifo) // stop buffering, nobody will drain it
+		imu->disableAccelFIFO();
+	devices[0].last_ready_ns = -1; // the next batch comes after a gap
+
+	// clear anything latched while the generators were being set up
+	imu->accelIntGen1Source();
+	imu->accelIntGen2Source();
+
+	if(irq)
+		route_irq(true);
+}
+
+static void disarm_hw_detect() { // resume sampling
+	imu->configAccelIntGen1(0, 0, 0);
+	imu->configAccelIntGen2(0, 0, 0);
+	if(irq)
+		route_irq(false);
+	if(fifo) // restart with an empty FIFO, clearing the overrun from the idle time
+		imu->enableAccelFIFO(LSM9DS0::FIFO_STREAM, fifo_watermark);
+	else // discard the stale sample, clearing its overflow bit
+		imu->readAccelWithStatus();
+}
+
+static bool wait_hw_detect() { // idle until the interrupt generators fire
+	if(irq)
+		wait_irq(hw_health_ms);
+	else
+		sleep_ms(hw_health_ms);
+
+	// reading the sources doubles as the health check: a hung IMU or bus
+	// stops the heartbeat
+	bool fired = LSM9DS0::accelIntGenActive(imu->accelIntGen1Source());
+	fired = LSM9DS0::accelIntGenActive(imu->accelIntGen2Source()) || fired;
+	heartbeat(&devices[0]);
+	return fired;
+}
+
+static int detect_batch(struct device *d, const struct xyz_raw *r, int first, int n,
+		bool *moved, float *deviation) { // a batch of samples
+	int i = first;
+	while(i < n && !d->calibrated) // calibration points go one at a time
+		calibrate_sample(d, r + i++);
+	int decided = i;
+	if(decided == n)
+		return n;
+
+	int64_t update_start = stats ? real_clock_ns() : 0;
+	float tracked_deviation[XYZ_BLOCK_SIZE];
+	while(i < n) {
+		int k = min(n - i, min(xyz_buf_size, XYZ_BLOCK_SIZE));
+		if(!d->baseline)
+			detect_block(d, r + i, k, moved + i, deviation ? deviation + i : NULL);
+		else { // the renormalization has to see the tracked mean move
+			k = min(k, xyz_buf_size - (int) d->tracked_samples);
+			detect_block(d, r + i, k, moved + i, tracked_deviation);
+			for(int j = 0; j < k; j++) {
+				track_baseline(d, r + i + j, tracked_deviation[j]);
+				if(deviation)
+					deviation[i + j] = tracked_deviation[j];
+			}
+		}
+		i += k;
+	}
+	if(stats) { // once per batch: the clock costs more than a sample
+		stats_detector_ns += real_clock_ns() - update_start - stats_clock_ns;
+		stats_updates += n - decided;
+	}
+	if(!latency_file.empty())
+		latency_decision();
+	return decided;
+}
+
+static void calibrate_sample(struct device *d, const struct xyz_raw *r) { // one point
+	struct xyz *p = d->xyz_buf + d->xyz_buf_pos;
+	struct xyz_raw *q = d->raw_buf + d->xyz_buf_pos;
+	*q = *r;
+	if(d->detector) // only the float detectors need g's
+		xyz_from_raw(d, p, q);
+
+	d->xyz_buf_pos = (d->xyz_buf_pos + 1) % xyz_buf_size; // advance next buffer slot
+
+	if(++d->calibration_samples < xyz_buf_size) // wait for enough points
+		return;
+	if(d->raw_detector) { // the raw detector calibrates in ticks
+		struct xyz raw_mean;
+		d->raw_detector->calibrate(d->raw_buf, xyz_buf_size, threshold, &raw_mean);
+		d->calibrated_mean.x = d->g_per_lsb * raw_mean.x;
+		d->calibrated_mean.y = d->g_per_lsb * raw_mean.y;
+		d->calibrated_mean.z = d->g_per_lsb * raw_mean.z;
+		d->calibrated_magnitude = xyz_magnitude(&d->calibrated_mean);
+	} else {
+		xyz_mean(&d->calibrated_mean, d->xyz_buf, xyz_buf_size); // calibrated mean
+		d->calibrated_magnitude = xyz_magnitude(&d->calibrated_mean); // calibrated magnitude
+		// renormalize the point buffer from the calibrated mean
+		for(int j = 0; j < xyz_buf_size; j++)
+			xyz_subtract(d->xyz_buf + j, &d->calibrated_mean);
+		d->detector->calibrate(d->xyz_buf, xyz_buf_size,
+				threshold * d->calibrated_magnitude);
+	}
+	d->calibrated = true; // done calibrating
+	if(recorder)
+		recorder_calibrated(recorder, d - &devices[0], &d->calibrated_mean);
+	if(track_tau_s > 0) // maybe follow drift from here on
+		d->baseline = new Baseline(&d->calibrated_mean, accel_odr_hz[accel_odr],
+				track_tau_s, track_quiet * threshold, track_confirm_s);
+}
+
+static void detect_block(struct device *d, const struct xyz_raw *r, int k,
+		bool *moved, float *deviation) { // up to a buffer of samples
+	int pos = d->xyz_buf_pos;
+	d->xyz_buf_pos = (pos + k) % xyz_buf_size;
+	for(int j = 0, slot = pos; j < k; j++, slot = slot + 1 < xyz_buf_size ? slot + 1 : 0) {
+		struct xyz_raw *q = d->raw_buf + slot;
+		struct xyz_raw evicted_raw = *q; // the reading leaving the detector's window
+		*q = r[j];
+		if(d->raw_detector) { // integers, one at a time
+			moved[j] = d->raw_detector->update(q, &evicted_raw);
+			if(deviation) // costs a sqrt
+				deviation[j] = device_deviation(d);
+		}
+	}
+	if(d->raw_detector)
+		return;
+
+	struct xyz_block block = {}; // renormalized from the calibrated mean
+	xyz_block_from_raw(&block, r, k, d->g_per_lsb, &d->calibrated_mean);
+	float magnitudes[XYZ_BLOCK_SIZE];
+	if(d->detector->update_block(&block, pos, k, moved, magnitudes)) {
+		xyz_block_store(&block, d->xyz_buf, xyz_buf_size, pos, k);
+		for(int j = 0; deviation && j < k; j++)
+			deviation[j] = magnitudes[j] / d->calibrated_magnitude;
+		return;
+	}
+	for(int j = 0; j < k; j++) { // the detector rescans the window, so fill it as it goes
+		struct xyz *p = d->xyz_buf + (pos + j) % xyz_buf_size;
+		struct xyz evicted = *p; // the sample leaving the detector's window
+		p->x = block.x[j];
+		p->y = block.y[j];
+		p->z = block.z[j];
+		moved[j] = d->detector->update(p, &evicted);
+		if(deviation)
+			deviation[j] = device_deviation(d);
+	}
+}
+
+static float device_deviation(struct device *d) { // relative deviation
+	return d->raw_detector ? d->raw_detector->deviation() :
+			d->detector->magnitude() / d->calibrated_magnitude;
+}
+
+static void track_baseline(struct device *d, const struct xyz_raw *r, float deviation) { // O(1)
+	struct xyz p = { d->g_per_lsb * r->x, d->g_per_lsb * r->y, d->g_per_lsb * r->z };
+	d->baseline->update(&p, deviation);
+	if(++d->tracked_samples < (uint32_t) xyz_buf_size)
+		return;
+	d->tracked_samples = 0;
+	d->baseline->reference(&d->calibrated_mean); // the float detectors renormalize from it
+	if(d->raw_detector) { // the raw detector keeps its own, in ticks
+		struct xyz ticks = { d->calibrated_mean.x / d->g_per_lsb,
+				d->calibrated_mean.y / d->g_per_lsb, d->calibrated_mean.z / d->g_per_lsb };
+		d->raw_detector->recenter(&ticks);
+	}
+}
+
+static float device_temperature(struct device *d, int64_t now_ns) { // maybe read it
+	if(!temperature_interval_ms || now_ns < d->temperature_due_ns)
+		return NAN;
+	d->temperature_due_ns = now_ns + temperature_interval_ms * 1000000LL;
+	d->imu->readTemp();
+	// 12 bits, right-justified, at 8 LSB per degree
+	return (int16_t) (d->imu->temperature << 4) / 16 / 8.0f;
+}
+
+static void watch_devices() { // sample the buses in parallel, detect here
+	for(size_t i = 0; i < devices.size(); i++) { // group the devices by bus
+		size_t b = 0;
+		while(b < buses.size() && buses[b].number != devices[i].bus)
+			b++;
+		if(b == buses.size()) {
+			struct bus bus = {}; // the thread is filled in once it starts
+			bus.number = devices[i].bus;
+			bus.sim = devices[i].sim;
+			bus.ring = new SampleRing(SAMPLE_RING_DEPTH);
+			buses.push_back(bus);
+		}
+		buses[b].devices.push_back(i);
+	}
+
+	sem_init(&batches_ready, 0, 0);
+	for(size_t i = 0; i < buses.size(); i++)
+		if(start_thread(&buses[i].thread, sample_bus, &buses[i]) != 0) {
+			cerr << "unable to start a thread for I2C bus " << buses[i].number << "\n";
+			exit(-1);
+		}
+
+	size_t stopped = 0, next = 0;
+	struct sample_batch b;
+	for(;;) {
+		while(sem_wait(&batches_ready) < 0) // one post per batch, in one of the rings
+			;
+		while(!buses[next].ring->pop(&b)) // take turns, so no bus starves the others
+			next = (next + 1) % buses.size();
+		next = (next + 1) % buses.size();
+		if(b.device < 0) { // a simulated bus ran out of time
+			if(++stopped == buses.size())
+				sim_timeout();
+			continue;
+		}
+
+		struct device *d = &devices[b.device];
+		if(!latency_file.empty())
+			b.dequeued_ns = d->sim ? d->sim->now() : real_clock_ns();
+
+		stats_samples += b.n;
+		devices_elapsed_ns = max(devices_elapsed_ns, b.read_ns - sampling_start_ns);
+		publish_batch(b.device, b.samples, b.n, b.overflow, b.read_ns);
+
+		if(d->baseline && !isnan(b.celsius))
+			d->baseline->temperature(b.celsius);
+		int first = discarded(b.read_ns, b.n); // discard early points
+		if(first == b.n) {
+			if(shared_state)
+				share_batch(d, b.samples, b.n, b.n, NULL, b.overflow, b.read_ns);
+			heartbeat(d);
+			continue;
+		}
+
+		if(!latency_file.empty())
+			latency_batch(d, b.ready_ns, b.read_ns, b.dequeued_ns, b.n, b.overflow);
+		bool batch_moved[LSM9DS0::ACCEL_FIFO_DEPTH];
+		float batch_deviation[LSM9DS0::ACCEL_FIFO_DEPTH];
+		int decided = detect_batch(d, b.samples, first, b.n, batch_moved,
+				keep_going || shared_state ? batch_deviation : NULL);
+		if(shared_state) // before any of its decisions can trigger
+			share_batch(d, b.samples, b.n, decided, batch_deviation, b.overflow, b.read_ns);
+		for(int i = decided; i < b.n; i++) { // act on every sample the device's detector decided
+			bool moved = batch_moved[i];
+			float deviation = 0;
+			if(keep_going) { // the rules see the most deviant device
+				d->deviation = batch_deviation[i];
+				for(size_t j = 0; j < devices.size(); j++)
+					deviation = max(deviation, devices[j].deviation);
+			} else if(shared_state)
+				deviation = batch_deviation[i];
+			if(moved || b.overflow)
+				moved_device = b.device;
+			react(moved, b.overflow, deviation, b.read_ns);
+		}
+		heartbeat(d); // the batch made it through the detector
+	}
+}
+
+static void *sample_bus(void *arg) { // one bus's acquisition thread
+	struct bus *bus = (struct bus *) arg;
+	struct sample_batch b;
+	while(!__sync_fetch_and_add(&buses_stopping, 0)) {
+		int64_t now = bus->sim ? bus->sim->now() : real_clock_ns();
+		if(bus->sim && sim_duration_ms && now / 1000000 >= sim_duration_ms) {
+			b.device = -1; // tell the detectors this bus is done
+			b.n = 0;
+			while(!bus->ring->push(&b) && !__sync_fetch_and_add(&buses_stopping, 0))
+				sched_yield();
+			sem_post(&batches_ready);
+			return NULL;
+		}
+
+		bool read = false;
+		for(size_t i = 0; i < bus->devices.size(); i++) {
+			struct device *d = &devices[bus->devices[i]];
+			b.device = bus->devices[i];
+			b.ready_ns = latency_file.empty() ? 0 : bus->sim ? bus->sim->now() : real_clock_ns();
+			b.n = xyz_read_accel(d, b.samples, &b.overflow);
+			if(b.n > 0) {
+				b.read_ns = bus->sim ? bus->sim->now() : real_clock_ns();
+				b.celsius = NAN;
+				if(track_tau_s > 0) // the detector thread feeds it to the baseline
+					b.celsius = device_temperature(d, b.read_ns);
+				b.overflow |= d->ring_overrun; // the detectors missed the batch before
+				// virtual time stands still while the detectors catch up, so a
+				// simulated bus waits for room instead of dropping the batch
+				while(bus->sim && bus->ring->full() && !__sync_fetch_and_add(&buses_stopping, 0))
+					sched_yield();
+				d->ring_overrun = !bus->ring->push(&b);
+				if(!d->ring_overrun)
+					sem_post(&batches_ready);
+				read = true;
+			}
+		}
+
+		if(!read) { // nothing new on the bus, sleep like the main loop
+			__sync_fetch_and_add(&stats_wakeups, 1);
+			if(bus->sim)
+				bus->sim->sleep(sample_delay_ms * 1000000LL);
+			else
+				usleep(sample_delay_ms * 1000);
+		}
+	}
+	return NULL;
+}
+
+static int start_thread(pthread_t *thread, void *(*fn)(void *), void *arg) { // masked
+	sigset_t old;
+	block_sigchld(&old); // the new thread inherits the mask
+	int err = pthread_create(thread, NULL, fn, arg);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return err;
+}
+
+static void block_sigchld(sigset_t *old) { // for threads to inherit
+	sigset_t chld;
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	pthread_sigmask(SIG_BLOCK, &chld, old);
+}
+
+static void stop_buses() { // tell the threads to return and wait for them
+	if(buses.empty())
+		return;
+	__sync_lock_test_and_set(&buses_stopping, 1);
+	for(size_t i = 0; i < buses.size(); i++)
+		pthread_join(buses[i].thread, NULL);
+}
+
+static void sim_timeout() { // report and exit
+	stop_buses();
+	if(!latency_file.empty())
+		dump_latency();
+	if(stats)
+		print_stats("timeout");
+	if(watchdog) // the feeder mustn't outlive the devices
+		stop_watchdog();
+	if(keep_going) // the actions already ran, if there was movement
 		exit(0);
-	execvp(*trigger_command, trigger_command);
+	cerr << "simulation ended without movement\n";
+	exit(1);
 }
 
-static struct xyz *xyz_add(struct xyz *p, struct xyz *q) { // add a coordinates
-	p->x += q->x;
-	p->y += q->y;
-	p->z += q->z;
-	return p;
+static void init_channels() { // create the channels that are turned on
+	Detector *d;
+	if(gyro_threshold > 0) {
+		if(!(d = make_detector(detector_name))) // the raw and band detectors only know the accelerometer
+			d = make_detector("sum");
+		gyro_channel = new Channel(d, xyz_buf_size, gyro_threshold, false,
+				(int64_t) (1e9 / gyro_odr_hz[gyro_odr / 4]));
+	}
+	if(mag_threshold > 0) {
+		if(!(d = make_detector(detector_name)))
+			d = make_detector("sum");
+		mag_channel = new Channel(d, xyz_buf_size, mag_threshold, true,
+				(int64_t) (1e9 / mag_odr_hz[mag_odr]));
+	}
 }
 
-static struct xyz *xyz_subtract(struct xyz *p, struct xyz *q) { // subtract a coordinate
-	p->x -= q->x;
-	p->y -= q->y;
-	p->z -= q->z;
-	return p;
+static void poll_channels() { // read the channels that are due
+	bool updated = false;
+	if(gyro_channel && clock_ns() >= gyro_channel->due()) {
+		uint8_t status = imu->readGyroWithStatus();
+		if(!LSM9DS0::accelStatusNewData(status))
+			gyro_channel->notReady(clock_ns());
+		else if(clock_ns() - sampling_start_ns < discard_time * 1000000LL)
+			gyro_channel->skip(clock_ns());
+		else {
+			struct xyz p = { imu->calcGyro(imu->gx), imu->calcGyro(imu->gy),
+					imu->calcGyro(imu->gz) };
+			gyro_channel->update(&p, clock_ns());
+			updated = true;
+		}
+	}
+	if(mag_channel && clock_ns() >= mag_channel->due()) {
+		uint8_t status = imu->readMagWithStatus();
+		if(!LSM9DS0::accelStatusNewData(status))
+			mag_channel->notReady(clock_ns());
+		else if(clock_ns() - sampling_start_ns < discard_time * 1000000LL)
+			mag_channel->skip(clock_ns());
+		else {
+			struct xyz p = { imu->calcMag(imu->mx), imu->calcMag(imu->my),
+					imu->calcMag(imu->mz) };
+			mag_channel->update(&p, clock_ns());
+			updated = true;
+		}
+	}
+	if(updated && combine_channels()) { // the accelerometer's deviation goes to the rules
+		decided_ns = clock_ns();
+		react(true, false, accel_deviation, decided_ns);
+	}
 }
 
-static float xyz_magnitude(struct xyz *p) { // coordinate magnitude
-	return sqrt(p->x*p->x + p->y*p->y + p->z*p->z);
+static bool combine_channels() { // any, all or weighted
+	Channel *channels[] = { gyro_channel, mag_channel };
+	bool moved = accel_moved;
+	float score = combine_weights[0] * accel_deviation / threshold;
+	for(int i = 0; i < 2; i++) {
+		if(!channels[i])
+			continue;
+		if(combine == COMBINE_ANY)
+			moved = moved || channels[i]->moved();
+		else if(combine == COMBINE_ALL)
+			moved = moved && channels[i]->moved();
+		else
+			score += combine_weights[i + 1] * channels[i]->ratio();
+	}
+	return combine == COMBINE_WEIGHTED ? score >= 1 : moved;
 }
 
-static struct xyz *xyz_mean(struct xyz *p, struct xyz *q, int n) { // mean coordinate
-	p->x = p->y = p->z = 0;
-	for(int i = 0; i < n; i++)
-		xyz_add(p, q++);
-	p->x /= n;
-	p->y /= n;
-	p->z /= n;
-	return p;
+static int64_t channel_sleep_ns(int64_t max_ns) { // until the next channel is due
+	Channel *channels[] = { gyro_channel, mag_channel };
+	int64_t now = clock_ns();
+	for(int i = 0; i < 2; i++)
+		if(channels[i])
+			max_ns = min(max_ns, max(channels[i]->due() - now, (int64_t) 0));
+	return max_ns;
 }
 
-static bool xyz_read_accel(struct xyz *p) { // read coordinate from IMU
-	if(imu->newXData()) {
-		while(imu->newXData()) {
-			imu->readAccel();
-			p->x = imu->calcAccel(imu->ax);
-			p->y = imu->calcAccel(imu->ay);
-			p->z = imu->calcAccel(imu->az);
+static void react(bool moved, bool overflow, float deviation, int64_t now_ns) { // act on a decision
+	if(shared_state) { // what the detector saw, whether or not anything triggers
+		state_begin(shared_state);
+		state_decision(shared_state, moved_device, moved || overflow, deviation, now_ns);
+		state_end(shared_state);
+	}
+	if(stream_only) // nothing to trigger, the subscribers decide for themselves
+		return;
+	if(keep_going) { // maybe start an action, and keep watching either way
+		if((moved || overflow) && deviation < threshold)
+			deviation = threshold; // welford's spread, an overflow, or another sensor
+		if(action_update(&rules[0], rules.size(), deviation, now_ns) >= 0 &&
+				!latency_file.empty())
+			histogram_record(&latency_exec, latency_clock_ns() - decided_ns);
+	} else if(moved || overflow) {
+		if(stats) { // the simulators and counters are still once the buses stop
+			stop_buses();
+			print_stats(moved ? "moved" : "overflow");
 		}
-		return true;
-	} else
-		return false;
+		trigger();
+	}
+}
+
+static void trigger() { // trigger the command
+	if(!latency_file.empty()) { // the exec is issued now, the dump only delays it
+		histogram_record(&latency_exec, latency_clock_ns() - decided_ns);
+		dump_latency();
+	}
+	if(watchdog) { // close the watchdog timer device so execvp'd command can't write to it
+		stop_watchdog();
+		close(watchdog_fd);
+	}
+	if(!trigger_command) {
+		stop_buses();
+		exit(0);
+	}
+	execve(trigger_path, trigger_command, environ); // resolved by parse_args()
+}
+
+static int xyz_read_accel(struct device *d, struct xyz_raw *p, bool *overflow) { // read raw samples
+	LSM9DS0 *imu = d->imu;
+	if(fifo) {
+		uint8_t status = imu->accelFIFOStatus();
+		*overflow = LSM9DS0::accelFIFOOverrun(status);
+		// with a watermark, leave the samples in the FIFO until there are enough
+		if(fifo_watermark && !LSM9DS0::accelFIFOWatermark(status) && !*overflow)
+			return 0;
+		int n = LSM9DS0::accelFIFOSamples(status);
+		int16_t raw[3 * LSM9DS0::ACCEL_FIFO_DEPTH];
+		imu->readAccelFIFO(raw, n); // one burst for the whole batch
+		for(int i = 0; i < n; i++, p++) {
+			p->x = raw[3*i];
+			p->y = raw[3*i + 1];
+			p->z = raw[3*i + 2];
+		}
+		return n;
+	}
+	// status and readings in one transaction; the readings are only used if new
+	uint8_t status = imu->readAccelWithStatus();
+	if(!LSM9DS0::accelStatusNewData(status))
+		return 0;
+	p->x = imu->ax;
+	p->y = imu->ay;
+	p->z = imu->az;
+	*overflow = LSM9DS0::accelStatusOverflow(status);
+	return 1;
+}
+
+static struct xyz *xyz_from_raw(struct device *d, struct xyz *p,
+		const struct xyz_raw *q) { // raw sample to g's
+	p->x = d->g_per_lsb * q->x;
+	p->y = d->g_per_lsb * q->y;
+	p->z = d->g_per_lsb * q->z;
+	return p;
 }
 
 static int64_t timestamp_ms() { // ms since first invocation of timestamp_ms()
-	struct timespec clk;
-	clock_gettime(CLOCK_MONOTONIC, &clk);
-	int64_t ms = clk.tv_sec * 1000;
-	ms += clk.tv_nsec / 1000000;
+	int64_t ms = clock_ns() / 1000000;
 	if(timestamp_initialized) {
 		return ms - timestamp_clockstart;
 	} else {
@@ -402,3 +2638,366 @@ static int64_t timestamp_ms() { // ms since first invocation of timestamp_ms()
 		return 0;
 	}
 }
+
+static int64_t clock_ns() { // monotonic or virtual time
+	if(sim)
+		return sim->now();
+	return real_clock_ns();
+}
+
+static void sleep_ms(int ms) { // real or virtual sleep
+	sleep_ns(ms * 1000000LL);
+}
+
+static void sleep_ns(int64_t ns) { // real or virtual sleep
+	stats_wakeups++;
+	if(sim)
+		sim->sleep(ns);
+	else {
+		struct timespec ts;
+		ts.tv_sec = ns / 1000000000;
+		ts.tv_nsec = ns % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+static int64_t real_clock_ns() { // monotonic time, never virtual
+	struct timespec clk;
+	clock_gettime(CLOCK_MONOTONIC, &clk);
+	return clk.tv_sec * 1000000000LL + clk.tv_nsec;
+}
+
+static void init_stats() { // calibrate the update timer
+	stats_clock_ns = -1;
+	for(int i = 0; i < 1000; i++) { // the cheapest back-to-back reading
+		int64_t start = real_clock_ns();
+		int64_t ns = real_clock_ns() - start;
+		if(stats_clock_ns < 0 || ns < stats_clock_ns)
+			stats_clock_ns = ns;
+	}
+}
+
+static void print_stats(const char *result) { // one line of JSON on stderr
+	cerr << boost::format("{\"result\": \"%1%\", \"odr\": %2%, \"buffer\": %3%, "
+			"\"detector\": \"%4%\", \"elapsed_ms\": %5%, \"samples\": %6%, "
+			"\"wakeups\": %7%, \"updates\": %8%, \"detector_ns\": %9%, \"kernels\": \"%10%\"")
+			% result % accel_odr_hz[accel_odr] % xyz_buf_size % detector_name
+			% (!buses.empty() ? devices_elapsed_ns / 1000000 : timestamp_ms()) % stats_samples % stats_wakeups % stats_updates
+			% stats_detector_ns % xyz_block_kernels;
+	if(!buses.empty()) {
+		uint64_t overruns = 0, dropped = 0;
+		uint32_t high_water = 0;
+		for(size_t i = 0; i < buses.size(); i++) {
+			overruns += buses[i].ring->overruns();
+			dropped += buses[i].ring->overrunSamples();
+			high_water = max(high_water, buses[i].ring->highWater());
+		}
+		cerr << boost::format(", \"ring_overruns\": %1%, \"ring_dropped\": %2%, "
+				"\"ring_high_water\": %3%") % overruns % dropped % high_water;
+	}
+	if(keep_going) {
+		uint64_t fired = 0, busy = 0;
+		for(size_t i = 0; i < rules.size(); i++) {
+			fired += rules[i].fired;
+			busy += rules[i].busy;
+		}
+		cerr << boost::format(", \"actions\": %1%, \"actions_busy\": %2%") % fired % busy;
+	}
+	if(watchdog) {
+		pthread_mutex_lock(&watchdog_lock); // the feeder counts under the lock
+		cerr << boost::format(", \"watchdog_feeds\": %1%") % watchdog_feeds;
+		pthread_mutex_unlock(&watchdog_lock);
+	}
+	if(streamer)
+		cerr << boost::format(", \"stream_subscribers\": %1%, \"stream_served\": %2%, "
+				"\"stream_dropped\": %3%") % streamer->subscribers % streamer->served
+				% streamer->dropped;
+	if(devices.size() > 1)
+		cerr << boost::format(", \"devices\": %1%, \"device\": %2%")
+				% devices.size() % moved_device;
+	if(track_tau_s > 0) {
+		uint64_t tracked = 0;
+		float coefficient = 0; // the steepest, mg per degree
+		for(size_t i = 0; i < devices.size(); i++)
+			if(devices[i].baseline) {
+				tracked += devices[i].baseline->tracked();
+				coefficient = max(coefficient,
+						1000 * xyz_magnitude(devices[i].baseline->coefficient()));
+			}
+		cerr << boost::format(", \"tracked\": %1%, \"temperature_mg_per_c\": %2$.3f")
+				% tracked % coefficient;
+	}
+	if(sim) {
+		int64_t motion_ns = -1; // the first movement
+		for(size_t i = 0; i < sim_motions.size(); i++) {
+			int64_t start = sim_motions[i].start_ms * 1000000;
+			if(motion_ns < 0 || start < motion_ns)
+				motion_ns = start;
+		}
+		int64_t sim_ns = 0; // the furthest bus
+		uint64_t transactions = 0, generated = 0, lost = 0;
+		for(size_t i = 0; i < devices.size(); i++) {
+			SimLSM9DS0 *s = devices[i].sim;
+			sim_ns = max(sim_ns, s->now());
+			transactions += s->transactions();
+			generated += s->accelSamples();
+			lost += s->accelSamplesLost();
+		}
+		cerr << boost::format(", \"sim_ms\": %1$.3f, \"transactions\": %2%, "
+				"\"generated\": %3%, \"lost\": %4%, \"motion_ms\": %5$.3f")
+				% (sim_ns / 1e6) % transactions % generated % lost
+				% (motion_ns < 0 ? -1 : motion_ns / 1e6);
+	}
+	cerr << "}\n";
+}
+
+static void init_recording(int64_t start_ns) { // map the ring file
+	if(devices.size() > RECORD_MAX_DEVICES)
+		cerr << "only the first " << RECORD_MAX_DEVICES <<
+				" devices' calibrations will be recorded\n";
+	struct record_header h;
+	memset(&h, 0, sizeof(h));
+	h.devices = devices.size();
+	h.odr_hz = accel_odr_hz[accel_odr];
+	h.g_per_lsb = imu->calcAccel(1);
+	h.scale_g = h.g_per_lsb * 32768; // full scale is 32768 ticks
+	h.threshold = threshold;
+	h.buffer = xyz_buf_size;
+	h.discard_ms = discard_time;
+	strncpy(h.detector, detector_name.c_str(), sizeof(h.detector) - 1);
+	h.bands = min(bands.size(), (size_t) RECORD_MAX_BANDS);
+	for(uint32_t i = 0; i < h.bands; i++) {
+		h.band[i].low_hz = bands[i].low_hz;
+		h.band[i].high_hz = bands[i].high_hz;
+	}
+	h.start_ns = start_ns;
+	if(!(recorder = recorder_create(record_file.c_str(), record_capacity, &h))) {
+		cerr << "unable to record to " << record_file << ": " << strerror(errno) << "\n";
+		exit(-1);
+	}
+}
+
+static void record_batch(int device, const struct xyz_raw *p, int n, bool overflow,
+		int64_t read_ns) { // stores only, apart from the occasional msync
+	// the trigger sees a batch's overflow with every sample, so replays must too
+	uint8_t status = RECORD_STATUS_NEW | (overflow ? RECORD_STATUS_OVERFLOW : 0);
+	for(int i = 0; i < n; i++)
+		recorder_append(recorder, device, sample_time(read_ns, n, i), p + i, status);
+	recorder_sync(recorder, read_ns);
+}
+
+static void init_stream() { // listen on the socket
+	struct stream_hello h;
+	memset(&h, 0, sizeof(h));
+	h.devices = devices.size();
+	h.odr_hz = accel_odr_hz[accel_odr];
+	h.g_per_lsb = imu->calcAccel(1);
+	h.scale_g = h.g_per_lsb * 32768; // full scale is 32768 ticks
+	if(!(streamer = streamer_create(stream_path.c_str(), &h))) {
+		cerr << "unable to stream on " << stream_path << ": " << strerror(errno) << "\n";
+		exit(-1);
+	}
+}
+
+static void publish_batch(int device, const struct xyz_raw *p, int n, bool overflow,
+		int64_t read_ns) { // to the recording and the stream
+	if(recorder)
+		record_batch(device, p, n, overflow, read_ns);
+	if(streamer)
+		streamer_publish(streamer, device, p, n,
+				RECORD_STATUS_NEW | (overflow ? RECORD_STATUS_OVERFLOW : 0), read_ns);
+}
+
+static void init_shared_state() { // map the state file
+	if(devices.size() > STATE_MAX_DEVICES)
+		cerr << "only the first " << STATE_MAX_DEVICES << " devices' state will be shared\n";
+	struct still_state s;
+	memset(&s, 0, sizeof(s));
+	s.devices = min(devices.size(), (size_t) STATE_MAX_DEVICES);
+	s.pid = getpid();
+	s.odr_hz = accel_odr_hz[accel_odr];
+	s.threshold = threshold;
+	if(!(shared_state = state_create(shm_file.c_str(), &s))) {
+		cerr << "unable to share state through " << shm_file << ": " << strerror(errno) << "\n";
+		exit(-1);
+	}
+}
+
+static void share_batch(struct device *d, const struct xyz_raw *r, int n, int decided,
+		const float *deviation, bool overflow, int64_t read_ns) { // a write per batch
+	int i = d - &devices[0];
+	if(i >= STATE_MAX_DEVICES)
+		return;
+	state_begin(shared_state);
+	struct state_device *s = shared_state->device_state + i;
+	s->calibrated = d->calibrated;
+	s->magnitude = d->calibrated_magnitude;
+	s->mean = d->calibrated_mean;
+	if(overflow)
+		s->overflows++;
+	for(int j = 0; j < n; j++) {
+		struct state_sample p;
+		p.t_ns = sample_time(read_ns, n, j);
+		p.x = d->g_per_lsb * r[j].x;
+		p.y = d->g_per_lsb * r[j].y;
+		p.z = d->g_per_lsb * r[j].z;
+		p.deviation = deviation && j >= decided ? deviation[j] : NAN;
+		state_append(shared_state, i, &p);
+	}
+	state_end(shared_state);
+}
+
+static int64_t sample_time(int64_t read_ns, int n, int i) { // one period apart
+	return read_ns - (n - 1 - i) * (int64_t) (1e9 / accel_odr_hz[accel_odr]);
+}
+
+static int discarded(int64_t read_ns, int n) { // the samples before the discard time ended
+	int64_t end = sampling_start_ns + discard_time * 1000000LL;
+	int i = 0;
+	while(i < n && sample_time(read_ns, n, i) < end)
+		i++;
+	return i;
+}
+
+static void replay() { // detect over a recording, at full speed
+	const struct record_header *h = replay_recording;
+	devices.resize(h->devices ? h->devices : 1); // the recorded devices, not --device
+	for(size_t i = 0; i < devices.size(); i++) {
+		struct device *d = &devices[i];
+		if(!d->xyz_buf)
+			init_device(d);
+		d->g_per_lsb = h->g_per_lsb;
+	}
+	vector<bool> moving(devices.size()); // was the device triggering already?
+
+	timestamp_ms(); // start the clock for the stats
+	bool triggered = false;
+	uint64_t n = record_samples(h);
+	struct xyz_raw batch[XYZ_BLOCK_SIZE];
+	bool batch_moved[XYZ_BLOCK_SIZE];
+	float batch_deviation[XYZ_BLOCK_SIZE];
+	bool stop = false; // at the first trigger point, without --keep-going
+	uint64_t i = 0;
+	while(i < n && !stop) {
+		// the next run of samples from one device, as a batch
+		int device = record_sample(h, i)->device;
+		int k = 0;
+		while(k < XYZ_BLOCK_SIZE && i + k < n) {
+			const struct record_sample *s = record_sample(h, i + k);
+			if(s->device != device || // discard early points, like discarded()
+					s->t_ns < h->start_ns + discard_time * 1000000LL)
+				break;
+			batch[k].x = s->x;
+			batch[k].y = s->y;
+			batch[k].z = s->z;
+			k++;
+		}
+		if(k == 0 || device >= (int) devices.size()) {
+			i += k ? k : 1;
+			continue;
+		}
+		stats_samples += k;
+
+		struct device *d = &devices[device];
+		int decided = detect_batch(d, batch, 0, k, batch_moved, batch_deviation);
+		for(int j = decided; j < k && !stop; j++) {
+			const struct record_sample *s = record_sample(h, i + j);
+			bool moved = batch_moved[j];
+			bool overflow = LSM9DS0::accelStatusOverflow(s->status);
+			if((moved || overflow) && !moving[device]) { // a trigger point
+				cout << boost::format("{\"t_ms\": %1$.3f, \"device\": %2%, \"sample\": %3%, "
+						"\"result\": \"%4%\", \"deviation\": %5$.6f}\n")
+						% ((s->t_ns - h->start_ns) / 1e6) % device % (i + j)
+						% (moved ? "moved" : "overflow") % batch_deviation[j];
+				triggered = true;
+				moved_device = device;
+				stop = !keep_going;
+			} else if(!moved && !overflow && moving[device]) // the movement ended
+				cout << boost::format("{\"t_ms\": %1$.3f, \"device\": %2%, \"sample\": %3%, "
+						"\"result\": \"still\", \"deviation\": %4$.6f}\n")
+						% ((s->t_ns - h->start_ns) / 1e6) % device % (i + j) % batch_deviation[j];
+			moving[device] = moved || overflow;
+		}
+		i += k;
+	}
+
+	cout.flush();
+	if(stats)
+		print_stats(triggered ? "moved" : "timeout");
+	exit(triggered ? 0 : 1);
+}
+
+static void init_latency() { // request dumps on SIGUSR1
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = latency_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL); // no SA_RESTART: wake the loop up to dump
+}
+
+static void latency_signal(int sig) { // only safe to set a flag here
+	latency_dump_requested = 1;
+}
+
+static void latency_batch(struct device *d, int64_t ready_ns, int64_t read_ns,
+		int64_t dequeued_ns, int n, bool overflow) { // time a batch
+	int64_t period = (int64_t) (1e9 / accel_odr_hz[accel_odr]);
+	histogram_record(&latency_read, read_ns - ready_ns);
+	if(dequeued_ns < 0) // no ring in between
+		dequeued_ns = read_ns;
+	else
+		histogram_record(&latency_queue, dequeued_ns - read_ns);
+	batch_ready_ns = ready_ns;
+	batch_read_ns = read_ns;
+	batch_dequeued_ns = dequeued_ns;
+	batch_device = d;
+
+	if(d->last_ready_ns >= 0) {
+		int64_t interval = ready_ns - d->last_ready_ns;
+		histogram_record(&latency_interval, interval);
+		histogram_record(&latency_jitter, llabs(interval - n * period));
+		// the loop should have come for the batch once it held the watermark
+		int budget = fifo_watermark ? fifo_watermark : 1;
+		if(interval > (budget + 1) * period)
+			late_samples += n;
+		if(overflow) { // at least one, likely as many as didn't fit the interval
+			int64_t missed = (interval + period / 2) / period - n;
+			missed_samples += missed > 1 ? missed : 1;
+		}
+	} else if(overflow)
+		missed_samples++;
+	d->last_ready_ns = ready_ns;
+}
+
+static void latency_decision() { // time a decision
+	decided_ns = latency_clock_ns();
+	histogram_record(&latency_detect, decided_ns - batch_dequeued_ns);
+	histogram_record(&latency_total, decided_ns - batch_ready_ns);
+}
+
+static int64_t latency_clock_ns() { // the batch's bus clock
+	if(batch_device && batch_device->sim)
+		return batch_device->sim->now();
+	return clock_ns();
+}
+
+static void dump_latency() { // replace latency_file
+	string tmp = latency_file + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "w");
+	if(!f) {
+		cerr << "unable to write " << tmp << ": " << strerror(errno) << "\n";
+		return;
+	}
+	fprintf(f, "odr_hz=%g samples=%llu late_samples=%llu missed_samples=%llu\n",
+			accel_odr_hz[accel_odr], (unsigned long long) stats_samples,
+			(unsigned long long) late_samples, (unsigned long long) missed_samples);
+	histogram_print(f, "read", &latency_read);
+	histogram_print(f, "queue", &latency_queue);
+	histogram_print(f, "detect", &latency_detect);
+	histogram_print(f, "exec", &latency_exec);
+	histogram_print(f, "total", &latency_total);
+	histogram_print(f, "interval", &latency_interval);
+	histogram_print(f, "jitter", &latency_jitter);
+	fclose(f);
+	rename(tmp.c_str(), latency_file.c_str()); // readers never see half a dump
+}
@@ -0,0 +1,119 @@
+/*
+ * stream.cpp
+ *
+ * Raw accelerometer samples streamed over a Unix domain socket
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "stream.h"
+
+/*
+ * Accept every subscriber waiting on s's socket, greeting each
+ */
+static void streamer_accept(struct streamer *s);
+/*
+ * Send the frame of length bytes at data to subscriber i without waiting,
+ * disconnecting it if it can't take the frame.  Returns false if it was
+ * disconnected, moving the last subscriber into its place.
+ */
+static bool streamer_send(struct streamer *s, int i, const void *data, size_t length);
+
+struct streamer *streamer_create(const char *path, const struct stream_hello *h) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	strcpy(addr.sun_path, path);
+
+	struct stat st; // a stale socket from an earlier run, but never anything else
+	if(stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0)
+		return NULL;
+	if(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return NULL;
+	}
+
+	struct streamer *s = (struct streamer *) malloc(sizeof(struct streamer));
+	memset(s, 0, sizeof(*s));
+	s->listen_fd = fd;
+	s->hello = *h;
+	memcpy(s->hello.magic, STREAM_MAGIC, sizeof(s->hello.magic));
+	s->hello.version = STREAM_VERSION;
+	s->accepted_ns = -STREAM_ACCEPT_NS; // look at the first publish
+	return s;
+}
+
+void streamer_publish(struct streamer *s, int device, const struct xyz_raw *p, int n,
+		uint8_t status, int64_t read_ns) {
+	if(read_ns - s->accepted_ns >= STREAM_ACCEPT_NS) {
+		streamer_accept(s);
+		s->accepted_ns = read_ns;
+	}
+
+	char frame[sizeof(struct stream_frame) + 32 * sizeof(struct xyz_raw)];
+	if(n > 32) // never more than a FIFO's worth, but don't overrun
+		n = 32;
+	struct stream_frame *f = (struct stream_frame *) frame;
+	f->seq = s->seq++;
+	f->read_ns = read_ns;
+	f->device = device;
+	f->n = n;
+	f->status = status;
+	f->reserved = 0;
+	memcpy(f + 1, p, n * sizeof(struct xyz_raw));
+	size_t length = sizeof(struct stream_frame) + n * sizeof(struct xyz_raw);
+	for(int i = 0; i < s->subscribers; )
+		if(streamer_send(s, i, frame, length))
+			i++;
+}
+
+static void streamer_accept(struct streamer *s) { // until nobody's waiting
+	for(;;) {
+		int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0) {
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return;
+		}
+		if(s->subscribers == STREAM_MAX_SUBSCRIBERS) {
+			close(fd);
+			continue;
+		}
+		int size = STREAM_SNDBUF;
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+		s->fds[s->subscribers++] = fd;
+		s->served++;
+		streamer_send(s, s->subscribers - 1, &s->hello, sizeof(s->hello));
+	}
+}
+
+static bool streamer_send(struct streamer *s, int i, const void *data, size_t length) {
+	ssize_t sent;
+	while((sent = send(s->fds[i], data, length, MSG_DONTWAIT | MSG_NOSIGNAL)) < 0 &&
+			errno == EINTR)
+		;
+	if(sent == (ssize_t) length)
+		return true;
+	if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) // too slow
+		s->dropped++;
+	close(s->fds[i]); // or gone
+	s->fds[i] = s->fds[--s->subscribers];
+	return false;
+}
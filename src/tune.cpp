@@ -0,0 +1,634 @@
+/*
+ * still-tune [options] recording[@ms]...
+ *
+ * Search still's trigger settings for the ones that best detect the movement
+ * in recordings made with still --record.  Every recording is replayed through
+ * the detectors under every combination of the settings to try, in parallel
+ * on every CPU, and the combinations that aren't beaten on both detection
+ * latency and false triggers (the Pareto front) are printed.
+ *
+ * Labeling recordings:
+ * recording: a recording of no movement, where every trigger is false
+ * recording@ms: a recording where movement starts ms milliseconds in, on the
+ * 		recording's clock as printed by still --replay.  Triggers before then
+ * 		are false, and the first sample after it that has moved detects it.
+ *
+ * Choosing the settings to try, each as a comma separated list of values or
+ * of first:last:step ranges:
+ * --buffer n: sample buffer sizes
+ * --threshold t: trigger thresholds
+ * --discard ms: discard times
+ * --odr hz: accelerometer ODRs: the recordings' ODR or any halving of it,
+ * 		replayed by keeping every second, fourth... sample.  The recordings'
+ * 		ODR by default.
+ * --detector d: detectors, comma separated
+ * --bands lo-hi[,lo-hi...]: frequency bands (Hz) for the band detector
+ *
+ * Running:
+ * --threads n: threads to run on, every CPU by default
+ * --all: print every combination, not just the front
+ *
+ * Every recording must have been made at the same ODR and scale.  A task is
+ * one recording under one combination; the tasks are split across threads
+ * that steal from each other once their own are done.
+ *
+ * Each combination printed is a line of JSON, front in order of latency:
+ * detector, buffer, threshold, discard_ms, odr: the settings
+ * latency_ms, latency_max_ms: mean and worst time from the movement to the
+ * 		trigger, over the recordings of movement
+ * false_per_hour: false triggers per hour the detectors watched before any
+ * 		movement
+ * false_triggers, missed: false triggers, and recordings of movement that
+ * 		never triggered.  Only combinations that miss nothing are on the front.
+ *
+ * A summary of the search is printed as JSON on stderr.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <boost/program_options.hpp>
+#include <boost/format.hpp>
+
+#include "xyz.h"
+#include "detector.h"
+#include "recording.h"
+#include "work_pool.h"
+
+namespace po = boost::program_options;
+
+using namespace std; // typing std:: all the time is annoying
+
+/*
+ * A labeled recording
+ */
+struct labeled {
+	string path;
+	const struct record_header *header;
+	int64_t motion_ns;	// when the movement starts, from the recording's start, or -1
+};
+
+/*
+ * A combination of settings
+ */
+struct config {
+	string detector;
+	int buffer;
+	float threshold;
+	int discard_ms;
+	int decimation;		// samples replayed per sample kept: the recorded ODR over this one
+};
+
+/*
+ * What replaying one recording under one combination found
+ */
+struct result {
+	uint32_t false_triggers;
+	int64_t quiet_ns;	// time the detectors watched before any movement
+	int64_t latency_ns;	// movement to trigger, or -1 if it never triggered or nothing moved
+	uint64_t samples;	// samples replayed
+};
+
+/*
+ * A combination's results over every recording
+ */
+struct score {
+	int config;
+	uint32_t false_triggers;
+	double false_per_hour;
+	int detected, missed;
+	double latency_ms, latency_max_ms;
+};
+
+/*
+ * A device's detector state while replaying, as in still
+ */
+struct replayer {
+	Detector *detector;
+	RawDetector *raw_detector;
+	struct xyz *xyz_buf;
+	struct xyz_raw *raw_buf;
+	int xyz_buf_pos;
+	int calibration_samples;
+	bool calibrated;
+	struct xyz calibrated_mean;
+	int skipped;	// samples since the last one kept
+	bool moving;	// was the device triggering already?
+};
+
+/*
+ * The recordings, and the ODR, scale and devices they share
+ */
+static vector<struct labeled> recordings;
+static float odr_hz;
+static float g_per_lsb;
+
+/*
+ * Frequency bands for the band detector
+ */
+static vector<struct band> bands;
+
+/*
+ * Every combination of the settings
+ */
+static vector<struct config> configs;
+
+/*
+ * One result per task: task t is recording t / configs.size() under
+ * combination t % configs.size()
+ */
+static vector<struct result> results;
+
+/*
+ * Threads to run on
+ */
+static int threads;
+
+/*
+ * Print every combination, not just the front?
+ */
+static bool print_all = false;
+
+
+int main(int argc, char **argv);
+
+/*
+ * Parse command-line arguments, open the recordings and list the combinations
+ */
+static void parse_args(int argc, char **argv);
+/*
+ * Append the values of list (comma separated values or first:last:step
+ * ranges) to *values, exiting with an error naming option if it doesn't parse
+ */
+static void parse_list(const string &list, const char *option, vector<double> *values);
+/*
+ * Open recording spec (path[@ms]) and append it to recordings
+ */
+static void open_recording(const string &spec);
+/*
+ * Replay a task's recording under its combination into its result; called
+ * from the pool's threads
+ */
+static void replay_task(uint64_t task, void *arg);
+/*
+ * Run raw sample *r through device d's detector, calibrating it first.
+ * Returns false while still calibrating, and otherwise whether it moved in
+ * *moved.
+ */
+static bool detect_sample(struct replayer *d, const struct config *c,
+		const struct xyz_raw *r, bool *moved);
+/*
+ * Sum each combination's results over the recordings into scores
+ */
+static void score_configs(vector<struct score> *scores);
+/*
+ * Print score s as a line of JSON
+ */
+static void print_score(const struct score *s);
+/*
+ * Is a better than b: lower latency, then fewer false triggers?
+ */
+static bool faster(const struct score &a, const struct score &b);
+/*
+ * Return the monotonic time in ns
+ */
+static int64_t clock_ns();
+
+int main(int argc, char **argv) {
+	parse_args(argc, argv);
+
+	int64_t start_ns = clock_ns();
+	results.resize(recordings.size() * configs.size());
+	WorkPool pool(threads);
+	pool.run(results.size(), replay_task, NULL);
+	int64_t elapsed_ns = clock_ns() - start_ns;
+
+	vector<struct score> scores;
+	score_configs(&scores);
+	sort(scores.begin(), scores.end(), faster);
+
+	double best = HUGE_VAL; // fewest false triggers of anything faster
+	for(size_t i = 0; i < scores.size(); i++) {
+		const struct score *s = &scores[i];
+		bool front = !s->missed && s->false_per_hour < best;
+		if(front)
+			best = s->false_per_hour;
+		if(front || print_all)
+			print_score(s);
+	}
+
+	uint64_t samples = 0;
+	for(size_t i = 0; i < results.size(); i++)
+		samples += results[i].samples;
+	cerr << boost::format("{\"recordings\": %1%, \"configurations\": %2%, \"tasks\": %3%, "
+			"\"threads\": %4%, \"steals\": %5%, \"samples\": %6%, \"elapsed_ms\": %7$.0f, "
+			"\"samples_per_s\": %8$.0f}\n")
+			% recordings.size() % configs.size() % results.size() % threads % pool.steals()
+			% samples % (elapsed_ns / 1e6) % (samples / (elapsed_ns / 1e9));
+	return 0;
+}
+
+static void parse_args(int argc, char **argv) { // parse args
+	vector<string> specs;
+
+	po::options_description visible;
+	po::options_description hidden;
+	po::options_description all;
+
+	string buffer_help =
+			string("sample buffer sizes (16,32,64,128,256)");
+	string threshold_help =
+			string("deviation thresholds (0.005:0.1:0.005)");
+	string discard_help =
+			string("initial discard ms (1000)");
+	string odr_help =
+			string("accelerometer ODRs Hz, the recorded one or halvings of it (recorded)");
+	string detector_help =
+			(boost::format("detectors: %1% (sum)") % detector_names).str();
+	string bands_help =
+			string("lo-hi[,lo-hi...] Hz bands for the band detector (20-200)");
+	string threads_help =
+			string("threads to run on (every CPU)");
+	string all_help =
+			string("print every combination, not just the Pareto front");
+
+	visible.add_options()
+			("help", "show this help")
+			("buffer", po::value<string>()->default_value("16,32,64,128,256", ""), buffer_help.c_str())
+			("threshold", po::value<string>()->default_value("0.005:0.1:0.005", ""), threshold_help.c_str())
+			("discard", po::value<string>()->default_value("1000", ""), discard_help.c_str())
+			("odr", po::value<string>(), odr_help.c_str())
+			("detector", po::value<string>()->default_value("sum", ""), detector_help.c_str())
+			("bands", po::value<string>()->default_value("20-200", ""), bands_help.c_str())
+			("threads", po::value<int>(), threads_help.c_str())
+			("all", all_help.c_str())
+			;
+	hidden.add_options()
+			("recording", po::value(&specs))
+			;
+	all.add(visible).add(hidden);
+
+	po::positional_options_description pdesc;
+	pdesc.add("recording", -1);
+
+	po::variables_map vm;
+	po::basic_parsed_options<char> parsed = po::command_line_parser(argc, argv).
+			options(all).
+			positional(pdesc).
+			allow_unregistered().
+			run();
+
+	po::store(parsed, vm);
+	po::notify(vm);
+
+	bool unrecognized =
+			po::collect_unrecognized(parsed.options, po::exclude_positional).size() > 0;
+
+	if(vm.count("help") || unrecognized || specs.empty()) {
+		cout << "usage: " << *argv << " [options] recording[@ms]...\n";
+		cout <<
+				"searches still's trigger settings over recordings of no movement, " <<
+				"or of movement starting ms in\n\n";
+		cout << "options:\n";
+		cout << visible;
+		exit(vm.count("help") ? 0 : -1);
+	}
+
+	for(size_t i = 0; i < specs.size(); i++)
+		open_recording(specs[i]);
+
+	vector<double> buffers, thresholds, discards, odrs;
+	parse_list(vm["buffer"].as<string>(), "--buffer", &buffers);
+	parse_list(vm["threshold"].as<string>(), "--threshold", &thresholds);
+	parse_list(vm["discard"].as<string>(), "--discard", &discards);
+	if(vm.count("odr"))
+		parse_list(vm["odr"].as<string>(), "--odr", &odrs);
+	else
+		odrs.push_back(odr_hz);
+
+	vector<int> decimations;
+	for(size_t i = 0; i < odrs.size(); i++) {
+		int k = 1;
+		while(k < 1024 && fabs(odr_hz / k - odrs[i]) > 0.01)
+			k *= 2;
+		if(k == 1024) {
+			cerr << "--odr " << odrs[i] << " isn't " << odr_hz << " Hz or a halving of it\n";
+			exit(-1);
+		}
+		decimations.push_back(k);
+	}
+
+	string band_specs = vm["bands"].as<string>();
+	for(size_t start = 0; start <= band_specs.size(); ) {
+		size_t end = band_specs.find(',', start);
+		if(end == string::npos)
+			end = band_specs.size();
+		string spec = band_specs.substr(start, end - start);
+		struct band b;
+		char extra;
+		if(sscanf(spec.c_str(), "%f-%f%c", &b.low_hz, &b.high_hz, &extra) != 2 ||
+				b.low_hz < 0 || b.high_hz < b.low_hz) {
+			cerr << "bad band " << spec << ", expected lo-hi in Hz\n";
+			exit(-1);
+		}
+		bands.push_back(b);
+		start = end + 1;
+	}
+	if(bands.size() > BAND_DETECTOR_MAX_BINS) {
+		cerr << "at most " << BAND_DETECTOR_MAX_BINS << " bands\n";
+		exit(-1);
+	}
+
+	vector<string> detectors;
+	string names = vm["detector"].as<string>();
+	for(size_t start = 0; start <= names.size(); ) {
+		size_t end = names.find(',', start);
+		if(end == string::npos)
+			end = names.size();
+		string name = names.substr(start, end - start);
+		Detector *detector = make_detector(name);
+		RawDetector *raw_detector = detector ? NULL : make_raw_detector(name);
+		if(!detector && !raw_detector && name != "band") {
+			cerr << "unknown detector " << name << ", try one of " << detector_names << "\n";
+			exit(-1);
+		}
+		for(size_t i = 0; raw_detector && i < buffers.size(); i++)
+			if(buffers[i] > RAW_DETECTOR_MAX_WINDOW) {
+				cerr << "detector " << name << " supports a buffer of at most " <<
+						RAW_DETECTOR_MAX_WINDOW << "\n";
+				exit(-1);
+			}
+		for(size_t i = 0; name == "band" && i < buffers.size(); i++)
+			for(size_t j = 0; j < decimations.size(); j++)
+				for(size_t k = 0; k < bands.size(); k++)
+					if(!band_bins(&bands[k], (int) buffers[i], odr_hz / decimations[j])) {
+						cerr << "band " << bands[k].low_hz << "-" << bands[k].high_hz <<
+								" has no DFT bin with a buffer of " << buffers[i] <<
+								" at " << odr_hz / decimations[j] << " Hz\n";
+						exit(-1);
+					}
+		delete detector;
+		delete raw_detector;
+		detectors.push_back(name);
+		start = end + 1;
+	}
+
+	for(size_t i = 0; i < buffers.size(); i++)
+		if(buffers[i] < 1) {
+			cerr << "--buffer must be at least 1\n";
+			exit(-1);
+		}
+
+	// every combination, with the cheap settings varying fastest
+	for(size_t d = 0; d < detectors.size(); d++)
+		for(size_t o = 0; o < decimations.size(); o++)
+			for(size_t b = 0; b < buffers.size(); b++)
+				for(size_t x = 0; x < discards.size(); x++)
+					for(size_t t = 0; t < thresholds.size(); t++) {
+						struct config c;
+						c.detector = detectors[d];
+						c.buffer = (int) buffers[b];
+						c.threshold = thresholds[t];
+						c.discard_ms = (int) discards[x];
+						c.decimation = decimations[o];
+						configs.push_back(c);
+					}
+
+	threads = vm.count("threads") ? vm["threads"].as<int>() : sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads < 1)
+		threads = 1;
+	print_all = vm.count("all");
+}
+
+static void parse_list(const string &list, const char *option, vector<double> *values) {
+	for(size_t start = 0; start <= list.size(); ) {
+		size_t end = list.find(',', start);
+		if(end == string::npos)
+			end = list.size();
+		string item = list.substr(start, end - start);
+		double first, last, step;
+		char extra;
+		int n = sscanf(item.c_str(), "%lf:%lf:%lf%c", &first, &last, &step, &extra);
+		if(n == 3 && step > 0 && last >= first) {
+			// count the steps rather than adding them up, so rounding can't lose the last
+			int steps = (int) floor((last - first) / step + 1e-6);
+			for(int i = 0; i <= steps; i++)
+				values->push_back(first + i * step);
+		} else if(sscanf(item.c_str(), "%lf%c", &first, &extra) == 1)
+			values->push_back(first);
+		else {
+			cerr << "can't parse " << option << " " << item <<
+					", try value or first:last:step, comma separated\n";
+			exit(-1);
+		}
+		start = end + 1;
+	}
+}
+
+static void open_recording(const string &spec) { // path, then an optional @ms
+	struct labeled l;
+	l.path = spec;
+	l.motion_ns = -1;
+	size_t at = spec.rfind('@');
+	if(at != string::npos) {
+		double ms;
+		char extra;
+		if(sscanf(spec.c_str() + at + 1, "%lf%c", &ms, &extra) != 1 || ms < 0) {
+			cerr << "can't parse recording " << spec << ", try path or path@ms\n";
+			exit(-1);
+		}
+		l.path = spec.substr(0, at);
+		l.motion_ns = (int64_t) (ms * 1000000);
+	}
+	if(!(l.header = record_open(l.path.c_str()))) {
+		cerr << "unable to open " << l.path << ": " <<
+				(errno == EINVAL ? "not a recording" : strerror(errno)) << "\n";
+		exit(-1);
+	}
+	if(recordings.empty()) {
+		odr_hz = l.header->odr_hz;
+		g_per_lsb = l.header->g_per_lsb;
+	} else if(l.header->odr_hz != odr_hz || l.header->g_per_lsb != g_per_lsb) {
+		cerr << l.path << " wasn't recorded at the same ODR and scale as " <<
+				recordings[0].path << "\n";
+		exit(-1);
+	}
+	recordings.push_back(l);
+}
+
+static void replay_task(uint64_t task, void *arg) { // one recording, one combination
+	const struct labeled *l = &recordings[task / configs.size()];
+	const struct config *c = &configs[task % configs.size()];
+	const struct record_header *h = l->header;
+	struct result *res = &results[task];
+	memset(res, 0, sizeof(*res));
+	res->latency_ns = -1;
+
+	int devices = h->devices ? h->devices : 1;
+	struct replayer replayers[RECORD_MAX_DEVICES];
+	memset(replayers, 0, sizeof(replayers));
+	for(int i = 0; i < devices; i++) {
+		struct replayer *d = &replayers[i];
+		d->xyz_buf = (struct xyz *) calloc(c->buffer, sizeof(struct xyz));
+		d->raw_buf = (struct xyz_raw *) calloc(c->buffer, sizeof(struct xyz_raw));
+		if(c->detector == "band")
+			d->detector = make_band_detector(&bands[0], bands.size(), odr_hz / c->decimation);
+		else if(!(d->detector = make_detector(c->detector)))
+			d->raw_detector = make_raw_detector(c->detector);
+		d->skipped = c->decimation - 1; // keep the first sample
+	}
+
+	int64_t discard_end = h->start_ns + c->discard_ms * 1000000LL;
+	int64_t motion_ns = l->motion_ns >= 0 ? h->start_ns + l->motion_ns : INT64_MAX;
+	int64_t watching_ns = -1, last_ns = -1; // quiet time the detectors watched
+	uint64_t n = record_samples(h);
+	const struct record_sample *ring = (const struct record_sample *) (h + 1);
+	uint64_t pos = (h->written - n) % h->capacity;
+	for(uint64_t i = 0; i < n; i++, pos = pos + 1 == h->capacity ? 0 : pos + 1) {
+		const struct record_sample *s = ring + pos;
+		if(s->device >= devices)
+			continue;
+		struct replayer *d = &replayers[s->device];
+		if(++d->skipped < c->decimation) // a lower ODR wouldn't have sampled it
+			continue;
+		d->skipped = 0;
+		if(s->t_ns < discard_end) // discard early points
+			continue;
+		res->samples++;
+
+		struct xyz_raw r = { s->x, s->y, s->z };
+		bool overflow = s->status & RECORD_STATUS_OVERFLOW;
+		bool moved;
+		if(!detect_sample(d, c, &r, &moved))
+			continue;
+		bool triggering = moved || overflow;
+
+		if(s->t_ns >= motion_ns) { // anything now detects the movement
+			if(triggering) {
+				res->latency_ns = s->t_ns - motion_ns;
+				break;
+			}
+			continue;
+		}
+		if(watching_ns < 0)
+			watching_ns = s->t_ns;
+		last_ns = s->t_ns;
+		if(triggering && !d->moving) // a trigger point, too early
+			res->false_triggers++;
+		d->moving = triggering;
+	}
+	if(watching_ns >= 0)
+		res->quiet_ns = last_ns - watching_ns;
+
+	for(int i = 0; i < devices; i++) {
+		delete replayers[i].detector;
+		delete replayers[i].raw_detector;
+		free(replayers[i].xyz_buf);
+		free(replayers[i].raw_buf);
+	}
+}
+
+static bool detect_sample(struct replayer *d, const struct config *c,
+		const struct xyz_raw *r, bool *moved) { // still's detect_sample(), per task
+	int n = c->buffer;
+	struct xyz *p = d->xyz_buf + d->xyz_buf_pos;
+	struct xyz evicted = *p; // the sample leaving the detector's window
+	struct xyz_raw *q = d->raw_buf + d->xyz_buf_pos;
+	struct xyz_raw evicted_raw = *q;
+	*q = *r;
+	if(d->detector) { // only the float detectors need g's
+		p->x = g_per_lsb * q->x;
+		p->y = g_per_lsb * q->y;
+		p->z = g_per_lsb * q->z;
+	}
+
+	d->xyz_buf_pos = (d->xyz_buf_pos + 1) % n; // advance next buffer slot
+
+	if(!d->calibrated) { // if still collecting calibration points
+		if(++d->calibration_samples == n) { // if we got enough points
+			if(d->raw_detector) { // the raw detector calibrates in ticks
+				struct xyz raw_mean;
+				d->raw_detector->calibrate(d->raw_buf, n, c->threshold, &raw_mean);
+			} else {
+				xyz_mean(&d->calibrated_mean, d->xyz_buf, n); // calibrated mean
+				// renormalize the point buffer from the calibrated mean
+				for(int j = 0; j < n; j++)
+					xyz_subtract(d->xyz_buf + j, &d->calibrated_mean);
+				d->detector->calibrate(d->xyz_buf, n,
+						c->threshold * xyz_magnitude(&d->calibrated_mean));
+			}
+			d->calibrated = true; // done calibrating
+		}
+		return false;
+	}
+
+	if(d->raw_detector)
+		*moved = d->raw_detector->update(q, &evicted_raw);
+	else {
+		xyz_subtract(p, &d->calibrated_mean); // renormalize the point from the calibrated mean
+		*moved = d->detector->update(p, &evicted);
+	}
+	return true;
+}
+
+static void score_configs(vector<struct score> *scores) { // over every recording
+	for(size_t i = 0; i < configs.size(); i++) {
+		struct score s;
+		memset(&s, 0, sizeof(s));
+		s.config = i;
+		int64_t quiet_ns = 0;
+		double latency_ns = 0;
+		int64_t latency_max_ns = 0;
+		for(size_t j = 0; j < recordings.size(); j++) {
+			const struct result *r = &results[j * configs.size() + i];
+			s.false_triggers += r->false_triggers;
+			quiet_ns += r->quiet_ns;
+			if(recordings[j].motion_ns < 0)
+				continue;
+			if(r->latency_ns < 0)
+				s.missed++;
+			else {
+				s.detected++;
+				latency_ns += r->latency_ns;
+				latency_max_ns = max(latency_max_ns, r->latency_ns);
+			}
+		}
+		// a trigger on the very first sample watched still counts against something
+		s.false_per_hour = s.false_triggers / (max(quiet_ns, (int64_t) 1) / 3.6e12);
+		s.latency_ms = s.detected ? latency_ns / s.detected / 1e6 : 0;
+		s.latency_max_ms = latency_max_ns / 1e6;
+		scores->push_back(s);
+	}
+}
+
+static void print_score(const struct score *s) { // one line
+	const struct config *c = &configs[s->config];
+	cout << boost::format("{\"detector\": \"%1%\", \"buffer\": %2%, \"threshold\": %3$.4f, "
+			"\"discard_ms\": %4%, \"odr\": %5%, \"latency_ms\": %6$.3f, "
+			"\"latency_max_ms\": %7$.3f, \"false_per_hour\": %8$.3f, "
+			"\"false_triggers\": %9%, \"missed\": %10%}\n")
+			% c->detector % c->buffer % c->threshold % c->discard_ms
+			% (odr_hz / c->decimation) % s->latency_ms % s->latency_max_ms
+			% s->false_per_hour % s->false_triggers % s->missed;
+}
+
+static bool faster(const struct score &a, const struct score &b) { // for sort()
+	if(a.latency_ms != b.latency_ms)
+		return a.latency_ms < b.latency_ms;
+	if(a.false_per_hour != b.false_per_hour)
+		return a.false_per_hour < b.false_per_hour;
+	return a.config < b.config;
+}
+
+static int64_t clock_ns() { // for timing the search
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
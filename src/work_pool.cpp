@@ -0,0 +1,103 @@
+/*
+ * work_pool.cpp
+ *
+ * A work-stealing pool of threads
+ */
+
+#include <stdlib.h>
+
+#include "work_pool.h"
+
+WorkPool::WorkPool(int threads) : threads(threads > 0 ? threads : 1) {
+	workers = (struct worker *) calloc(this->threads, sizeof(struct worker));
+	for(int i = 0; i < this->threads; i++) {
+		workers[i].pool = this;
+		pthread_mutex_init(&workers[i].lock, NULL);
+	}
+}
+
+WorkPool::~WorkPool() {
+	for(int i = 0; i < threads; i++)
+		pthread_mutex_destroy(&workers[i].lock);
+	free(workers);
+}
+
+void WorkPool::run(uint64_t tasks, void (*fn)(uint64_t task, void *arg), void *arg) {
+	this->fn = fn;
+	this->arg = arg;
+	for(int i = 0; i < threads; i++) { // neighboring tasks go to the same thread
+		workers[i].next = tasks * i / threads;
+		workers[i].end = tasks * (i + 1) / threads;
+		workers[i].steals = 0;
+	}
+	// the calling thread is worker 0
+	for(int i = 1; i < threads; i++)
+		pthread_create(&workers[i].thread, NULL, work, workers + i);
+	work(workers);
+	for(int i = 1; i < threads; i++)
+		pthread_join(workers[i].thread, NULL);
+}
+
+uint64_t WorkPool::steals() {
+	uint64_t n = 0;
+	for(int i = 0; i < threads; i++)
+		n += workers[i].steals;
+	return n;
+}
+
+void *WorkPool::work(void *p) { // until there's nothing left anywhere
+	struct worker *w = (struct worker *) p;
+	WorkPool *pool = w->pool;
+	uint64_t task;
+	for(;;) {
+		while(pool->take(w, &task))
+			pool->fn(task, pool->arg);
+		if(!pool->steal(w))
+			return NULL;
+	}
+}
+
+bool WorkPool::take(struct worker *w, uint64_t *task) { // from the front of our slice
+	pthread_mutex_lock(&w->lock);
+	bool taken = w->next < w->end;
+	if(taken)
+		*task = w->next++;
+	pthread_mutex_unlock(&w->lock);
+	return taken;
+}
+
+bool WorkPool::steal(struct worker *w) { // the back half of the fullest slice
+	for(;;) {
+		struct worker *victim = NULL;
+		uint64_t most = 0;
+		for(int i = 0; i < threads; i++) { // it may shrink before we lock it again
+			struct worker *v = workers + i;
+			pthread_mutex_lock(&v->lock);
+			uint64_t left = v->end - v->next;
+			pthread_mutex_unlock(&v->lock);
+			if(v != w && left > most) {
+				victim = v;
+				most = left;
+			}
+		}
+		if(!victim) // every slice is empty: only running tasks are left
+			return false;
+
+		pthread_mutex_lock(&victim->lock);
+		uint64_t left = victim->end - victim->next;
+		uint64_t from = victim->end - left / 2, end = victim->end;
+		if(left == 1) // the owner would get to it, but we're idle now
+			from = victim->next;
+		victim->end = from;
+		pthread_mutex_unlock(&victim->lock);
+		if(from == end) // emptied since we looked
+			continue;
+
+		pthread_mutex_lock(&w->lock);
+		w->next = from;
+		w->end = end;
+		w->steals++;
+		pthread_mutex_unlock(&w->lock);
+		return true;
+	}
+}
@@ -0,0 +1,214 @@
+/*
+ * xyz.cpp
+ *
+ * (x,y,z) coordinate arithmetic
+ */
+
+#include <math.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "xyz.h"
+
+struct xyz *xyz_add(struct xyz *p, const struct xyz *q) { // add a coordinates
+	p->x += q->x;
+	p->y += q->y;
+	p->z += q->z;
+	return p;
+}
+
+struct xyz *xyz_subtract(struct xyz *p, const struct xyz *q) { // subtract a coordinate
+	p->x -= q->x;
+	p->y -= q->y;
+	p->z -= q->z;
+	return p;
+}
+
+float xyz_magnitude(const struct xyz *p) { // coordinate magnitude
+	return sqrt(p->x*p->x + p->y*p->y + p->z*p->z);
+}
+
+struct xyz *xyz_mean(struct xyz *p, const struct xyz *q, int n) { // mean coordinate
+	p->x = p->y = p->z = 0;
+	for(int i = 0; i < n; i++)
+		xyz_add(p, q++);
+	p->x /= n;
+	p->y /= n;
+	p->z /= n;
+	return p;
+}
+
+#if defined(__SSSE3__)
+const char *xyz_block_kernels = "ssse3";
+#elif defined(__SSE2__)
+const char *xyz_block_kernels = "sse2";
+#else
+const char *xyz_block_kernels = "scalar";
+#endif
+
+#ifdef __SSSE3__
+// pshufb masks gathering each axis of eight interleaved readings (three
+// vectors of eight int16) into one vector of eight int16
+static const int8_t raw_masks[3][3][16] __attribute__((aligned(16))) = {
+	{ { 0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, 10, 11 } },
+	{ { 2, 3, 8, 9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, 4, 5, 10, 11, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 6, 7, 12, 13 } },
+	{ { 4, 5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, 0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1 },
+	  { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15 } },
+};
+
+// one axis of eight readings to g's, renormalized, into out[0..7]
+static inline void raw_axis(float *out, __m128i v0, __m128i v1, __m128i v2, int axis,
+		__m128 scale, __m128 mean) {
+	__m128i a = _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(v0, _mm_load_si128((const __m128i *) raw_masks[axis][0])),
+			_mm_shuffle_epi8(v1, _mm_load_si128((const __m128i *) raw_masks[axis][1]))),
+			_mm_shuffle_epi8(v2, _mm_load_si128((const __m128i *) raw_masks[axis][2])));
+	// sign-extend to 32 bits by shifting each int16 into the top half
+	__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);
+	__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+	_mm_store_ps(out, _mm_sub_ps(_mm_mul_ps(scale, _mm_cvtepi32_ps(lo)), mean));
+	_mm_store_ps(out + 4, _mm_sub_ps(_mm_mul_ps(scale, _mm_cvtepi32_ps(hi)), mean));
+}
+#endif
+
+struct xyz_block *xyz_block_from_raw(struct xyz_block *b, const struct xyz_raw *q, int k,
+		float scale, const struct xyz *mean) { // ticks to renormalized g's
+	int i = 0;
+#ifdef __SSSE3__
+	__m128 s = _mm_set1_ps(scale);
+	__m128 mx = _mm_set1_ps(mean->x), my = _mm_set1_ps(mean->y), mz = _mm_set1_ps(mean->z);
+	for(; i + 8 <= k; i += 8) { // eight readings are exactly three vectors
+		const __m128i *v = (const __m128i *) (q + i);
+		__m128i v0 = _mm_loadu_si128(v), v1 = _mm_loadu_si128(v + 1), v2 = _mm_loadu_si128(v + 2);
+		raw_axis(b->x + i, v0, v1, v2, 0, s, mx);
+		raw_axis(b->y + i, v0, v1, v2, 1, s, my);
+		raw_axis(b->z + i, v0, v1, v2, 2, s, mz);
+	}
+#endif
+	for(; i < k; i++) {
+		b->x[i] = scale * q[i].x - mean->x;
+		b->y[i] = scale * q[i].y - mean->y;
+		b->z[i] = scale * q[i].z - mean->z;
+	}
+	return b;
+}
+
+struct xyz_block *xyz_block_load(struct xyz_block *b, const struct xyz *ring, int n,
+		int first, int k) { // AoS to SoA
+	int i = 0, slot = first;
+	while(i < k) {
+		if(slot == n)
+			slot = 0;
+#ifdef __SSE2__
+		if(i + 4 <= k && slot + 4 <= n) { // x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+			const float *f = &ring[slot].x;
+			__m128 in0 = _mm_loadu_ps(f), in1 = _mm_loadu_ps(f + 4), in2 = _mm_loadu_ps(f + 8);
+			__m128 t = _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(1, 1, 2, 2));
+			_mm_storeu_ps(b->x + i, _mm_shuffle_ps(in0, t, _MM_SHUFFLE(2, 0, 3, 0)));
+			__m128 t0 = _mm_shuffle_ps(in0, in1, _MM_SHUFFLE(0, 0, 1, 1));
+			__m128 t1 = _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(2, 2, 3, 3));
+			_mm_storeu_ps(b->y + i, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0)));
+			t0 = _mm_shuffle_ps(in0, in1, _MM_SHUFFLE(1, 1, 2, 2));
+			t1 = _mm_shuffle_ps(in2, in2, _MM_SHUFFLE(3, 3, 0, 0));
+			_mm_storeu_ps(b->z + i, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0)));
+			i += 4;
+			slot += 4;
+			continue;
+		}
+#endif
+		b->x[i] = ring[slot].x;
+		b->y[i] = ring[slot].y;
+		b->z[i] = ring[slot].z;
+		i++;
+		slot++;
+	}
+	return b;
+}
+
+void xyz_block_store(const struct xyz_block *b, struct xyz *ring, int n,
+		int first, int k) { // SoA to AoS
+	int i = 0, slot = first;
+	while(i < k) {
+		if(slot == n)
+			slot = 0;
+#ifdef __SSE2__
+		if(i + 4 <= k && slot + 4 <= n) {
+			__m128 x = _mm_loadu_ps(b->x + i), y = _mm_loadu_ps(b->y + i), z = _mm_loadu_ps(b->z + i);
+			__m128 xy0 = _mm_unpacklo_ps(x, y), xy1 = _mm_unpackhi_ps(x, y); // x0 y0 x1 y1, x2 y2 x3 y3
+			float *f = &ring[slot].x;
+			__m128 t = _mm_shuffle_ps(z, xy0, _MM_SHUFFLE(2, 2, 0, 0));
+			_mm_storeu_ps(f, _mm_shuffle_ps(xy0, t, _MM_SHUFFLE(2, 0, 1, 0)));
+			t = _mm_shuffle_ps(xy0, z, _MM_SHUFFLE(1, 1, 3, 3));
+			_mm_storeu_ps(f + 4, _mm_shuffle_ps(t, xy1, _MM_SHUFFLE(1, 0, 2, 0)));
+			__m128 t0 = _mm_shuffle_ps(z, xy1, _MM_SHUFFLE(2, 2, 2, 2));
+			__m128 t1 = _mm_shuffle_ps(xy1, z, _MM_SHUFFLE(3, 3, 3, 3));
+			_mm_storeu_ps(f + 8, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0)));
+			i += 4;
+			slot += 4;
+			continue;
+		}
+#endif
+		ring[slot].x = b->x[i];
+		ring[slot].y = b->y[i];
+		ring[slot].z = b->z[i];
+		i++;
+		slot++;
+	}
+}
+
+struct xyz_block *xyz_block_window_means(struct xyz_block *means, const struct xyz_block *p,
+		const struct xyz_block *evicted, int from, int to, int n, double *sums) { // sliding sums
+	double s[3][XYZ_BLOCK_SIZE] __attribute__((aligned(16)));
+	// the sums depend on each other, so they're sequential...
+	double sx = sums[0], sy = sums[1], sz = sums[2];
+	for(int i = from; i < to; i++) {
+		s[0][i] = sx += (double) p->x[i] - evicted->x[i];
+		s[1][i] = sy += (double) p->y[i] - evicted->y[i];
+		s[2][i] = sz += (double) p->z[i] - evicted->z[i];
+	}
+	sums[0] = sx;
+	sums[1] = sy;
+	sums[2] = sz;
+	// ...but the means don't
+	int i = from;
+#ifdef __SSE2__
+	__m128d d = _mm_set1_pd(n);
+	for(; i + 4 <= to; i += 4) {
+		float *out[3] = { means->x + i, means->y + i, means->z + i };
+		for(int a = 0; a < 3; a++) {
+			__m128 lo = _mm_cvtpd_ps(_mm_div_pd(_mm_loadu_pd(s[a] + i), d));
+			__m128 hi = _mm_cvtpd_ps(_mm_div_pd(_mm_loadu_pd(s[a] + i + 2), d));
+			_mm_storeu_ps(out[a], _mm_movelh_ps(lo, hi));
+		}
+	}
+#endif
+	for(; i < to; i++) {
+		means->x[i] = (float) (s[0][i] / n);
+		means->y[i] = (float) (s[1][i] / n);
+		means->z[i] = (float) (s[2][i] / n);
+	}
+	return means;
+}
+
+void xyz_block_magnitudes(const struct xyz_block *b, int k, float *m) { // many xyz_magnitude()s
+	int i = 0;
+#ifdef __SSE2__
+	for(; i + 4 <= k; i += 4) {
+		__m128 x = _mm_load_ps(b->x + i), y = _mm_load_ps(b->y + i), z = _mm_load_ps(b->z + i);
+		__m128 sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		_mm_storeu_ps(m + i, _mm_sqrt_ps(sq));
+	}
+#endif
+	for(; i < k; i++) {
+		struct xyz p = { b->x[i], b->y[i], b->z[i] };
+		m[i] = xyz_magnitude(&p);
+	}
+}
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# detectors.sh still-sim
+#
+# Record still-sim at every accelerometer scale, moving the simulated
+# accelerometer by steps and vibrations around the thresholds tried, and check
+# that the int detector decides exactly like boxcar on every recording.  Each
+# recording is replayed through still's own batch path with --keep-going,
+# which prints the start and end of every movement, so the two agree on every
+# sample if and only if their output does.  Exits non-zero on the first
+# difference.
+#
+# Environment:
+# SCALES: --scale values to record at (2 4 6 8 16)
+# BUFFERS: --buffer sizes to replay with (8 32 128 512)
+# THRESHOLDS: --threshold values to replay with (0.001 0.005 0.01 0.02 0.05 0.1)
+# ODR: ODR to record at, in Hz (400)
+# DURATION: simulated ms per recording (30000)
+
+still=${1:?usage: detectors.sh still-sim}
+
+SCALES=${SCALES:-"2 4 6 8 16"}
+BUFFERS=${BUFFERS:-"8 32 128 512"}
+THRESHOLDS=${THRESHOLDS:-"0.001 0.005 0.01 0.02 0.05 0.1"}
+ODR=${ODR:-400}
+DURATION=${DURATION:-30000}
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+# the decisions, without the deviations: int's come from integer sums
+decisions() {
+	"$still" --replay "$1" --keep-going --detector $2 --buffer $3 --threshold $4 \
+			> "$dir/replay"
+	if [ $? -gt 1 ]; then # 1 is just nothing triggering
+		echo "unable to replay with --detector $2 --buffer $3 --threshold $4" >&2
+		exit 1
+	fi
+	sed 's/, "deviation": .*/}/' "$dir/replay"
+}
+
+configurations=0
+transitions=0
+for scale in $SCALES; do
+	# a threshold nothing reaches, so the recording runs for the whole duration
+	"$still" --scale $scale --odr $ODR --threshold 100 --sim-seed $scale \
+			--sim-duration $DURATION --record "$dir/$scale.bin" \
+			--sim-motion 3000:2000:0.002 --sim-motion 6000:2000:0.01:0:y \
+			--sim-motion 9000:3000:0.02:5:z --sim-motion 13000:2000:-0.05 \
+			--sim-motion 16000:4000:0.005:2 --sim-motion 21000:3000:0.1:20:y \
+			--sim-motion 25000:2000:0.03:0:z >/dev/null 2>&1
+	if [ ! -s "$dir/$scale.bin" ]; then
+		echo "unable to record at --scale $scale" >&2
+		exit 1
+	fi
+
+	for buffer in $BUFFERS; do
+		for threshold in $THRESHOLDS; do
+			decisions "$dir/$scale.bin" boxcar $buffer $threshold > "$dir/boxcar"
+			decisions "$dir/$scale.bin" int $buffer $threshold > "$dir/int"
+			if ! cmp -s "$dir/boxcar" "$dir/int"; then
+				echo "--scale $scale --buffer $buffer --threshold $threshold:" \
+						"int decides differently from boxcar" >&2
+				diff "$dir/boxcar" "$dir/int" | head -10 >&2
+				exit 1
+			fi
+			configurations=$((configurations + 1))
+			transitions=$((transitions + $(wc -l < "$dir/boxcar")))
+		done
+	done
+done
+
+echo "{\"scales\": $(echo $SCALES | wc -w), \"configurations\": $configurations," \
+		"\"transitions\": $transitions, \"differences\": 0}"
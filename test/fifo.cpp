@@ -0,0 +1,83 @@
+/*
+ * fifo
+ *
+ * Check the LSM9DS0 driver's accelerometer FIFO drains against the simulated
+ * LSM9DS0: a partly filled FIFO drains exactly what it holds, and a full,
+ * overrun FIFO drains all ACCEL_FIFO_DEPTH samples, though FIFO_SRC_REG's
+ * level only counts to 31, leaving nothing behind for the next batch.  Prints
+ * the first failure and exits 1, or one line of JSON.  `make test` runs it.
+ */
+
+#include <iostream>
+#include <stdint.h>
+
+#include "SFE_LSM9DS0.h"
+#include "sim_lsm9ds0.h"
+
+using namespace std; // typing std:: all the time is annoying
+
+/*
+ * Accelerometer sample period at A_ODR_50
+ */
+#define PERIOD_NS 20000000LL
+
+/*
+ * Checks made so far
+ */
+static int checks = 0;
+
+
+int main(int argc, char **argv);
+
+/*
+ * Let samples accumulate for periods sample periods, then drain the FIFO
+ * once as still does, and check it drained expected samples, with overrun
+ * set as expected, and left it empty.  Returns false, having printed why,
+ * if not.
+ */
+static bool drain(SimLSM9DS0 *sim, LSM9DS0 *imu, const char *what, int periods,
+		int expected, bool overrun);
+
+int main(int argc, char **argv) {
+	SimLSM9DS0 sim;
+	sim.setBusSpeed(0); // no samples arrive during the drains
+	LSM9DS0 imu(sim.gyroBus(), sim.xmBus());
+	imu.begin(LSM9DS0::G_SCALE_245DPS, LSM9DS0::A_SCALE_2G, LSM9DS0::M_SCALE_2GS,
+			LSM9DS0::G_ODR_95_BW_125, LSM9DS0::A_ODR_50, LSM9DS0::M_ODR_50,
+			LSM9DS0::A_ABW_773, LSM9DS0::INIT_ACCEL);
+	imu.enableAccelFIFO(LSM9DS0::FIFO_STREAM);
+	sim.sleep(PERIOD_NS / 2); // read between samples
+	drain(&sim, &imu, "emptying", 0, -1, false); // whatever begin() left
+
+	if(!drain(&sim, &imu, "partly filled", 10, 10, false) ||
+			!drain(&sim, &imu, "one sample", 1, 1, false) ||
+			!drain(&sim, &imu, "31 samples", 31, 31, false) ||
+			!drain(&sim, &imu, "overrun", 40, LSM9DS0::ACCEL_FIFO_DEPTH, true) ||
+			!drain(&sim, &imu, "after the overrun", 1, 1, false) ||
+			!drain(&sim, &imu, "overrun again", 100, LSM9DS0::ACCEL_FIFO_DEPTH, true))
+		return 1;
+
+	cout << "{\"checks\": " << checks << ", \"failures\": 0}\n";
+	return 0;
+}
+
+static bool drain(SimLSM9DS0 *sim, LSM9DS0 *imu, const char *what, int periods,
+		int expected, bool overrun) { // one batch, like xyz_read_accel()
+	sim->sleep(periods * PERIOD_NS);
+	uint8_t status = imu->accelFIFOStatus();
+	int n = LSM9DS0::accelFIFOSamples(status);
+	int16_t raw[3 * LSM9DS0::ACCEL_FIFO_DEPTH];
+	imu->readAccelFIFO(raw, n);
+	if(expected < 0)
+		return true;
+
+	checks++;
+	bool left = !(imu->accelFIFOStatus() & 0x20); // EMPTY
+	if(n == expected && LSM9DS0::accelFIFOOverrun(status) == overrun && !left)
+		return true;
+	cerr << what << ": drained " << n << " samples" <<
+			(LSM9DS0::accelFIFOOverrun(status) ? " with" : " without") << " overrun" <<
+			(left ? " and left some behind" : "") << ", expected " << expected <<
+			(overrun ? " with" : " without") << " overrun\n";
+	return false;
+}